@@ -20,40 +20,88 @@
 
 #include "config.h"
 #include "audio_priv.h"
+#include "trace.h"
 
 #ifdef HAVE_ALSA_ASOUNDLIB_H
 
 #include <alsa/asoundlib.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+/* The number of PCM descriptors polled while draining. */
+#define MAX_POLL_FDS 8
+
+/* snd_pcm_resume is retried with a backoff that doubles from 1ms up to
+ * RESUME_MAX_WAIT_MS, for up to RESUME_TIMEOUT_MS before preparing the
+ * device instead. */
+#define RESUME_MAX_WAIT_MS 32
+#define RESUME_TIMEOUT_MS 250
+
 struct alsa_object
 {
 	struct audio_object vtable;
 	snd_pcm_t *handle;
+	snd_pcm_hw_params_t *hw_params; // negotiated, to reset the device on flush
+	snd_pcm_sw_params_t *sw_params; // installed again after the hw_params
+	snd_pcm_uframes_t buffer_frames;
+	snd_pcm_uframes_t start_frames; // start threshold, for audio_object_commit
+	snd_pcm_format_t pcm_format;
 	uint8_t sample_size;
+	snd_pcm_uframes_t skip; // frames to drop after an xrun, for AUDIO_OBJECT_XRUN_SKIP
 	char *device;
+	/* mmap state for audio_object_begin_write/commit */
+	int mmap;
+	snd_pcm_uframes_t mmap_offset;
 	/* saved audio_object_open parameters */
 	int is_open;
 	enum audio_object_format format;
 	uint32_t rate;
 	uint8_t channels;
+	/* written to by a flush to wake a thread waiting in drain_until */
+	int wake[2];
+	/* the handle pool key the device was opened with */
+	struct audio_pool_key key;
 };
 
 #define to_alsa_object(object) container_of(object, struct alsa_object, vtable)
 
-int
-alsa_object_open(struct audio_object *object,
-                 enum audio_object_format format,
-                 uint32_t rate,
-                 uint8_t channels)
+/* A configured PCM kept in the handle pool, ready to play. */
+struct alsa_handle
 {
-	struct alsa_object *self = to_alsa_object(object);
-	if (self->handle)
-		return -EEXIST;
-
+	snd_pcm_t *handle;
+	snd_pcm_hw_params_t *hw_params;
+	snd_pcm_sw_params_t *sw_params;
 	snd_pcm_format_t pcm_format;
-#define FORMAT(srcfmt, dstfmt, size) case srcfmt: pcm_format = dstfmt; self->sample_size = size*channels; break;
+	uint8_t sample_size;
+	int mmap;
+	snd_pcm_uframes_t buffer_frames;
+	snd_pcm_uframes_t start_frames;
+	enum audio_object_format device_format;
+	unsigned int device_rate;
+	unsigned int device_channels;
+	struct audio_buffering negotiated;
+};
+
+static void
+alsa_handle_release(void *data)
+{
+	struct alsa_handle *pooled = data;
+	snd_pcm_close(pooled->handle);
+	snd_pcm_hw_params_free(pooled->hw_params);
+	if (pooled->sw_params)
+		snd_pcm_sw_params_free(pooled->sw_params);
+	free(pooled);
+}
+
+static int
+alsa_format(enum audio_object_format format,
+            snd_pcm_format_t *pcm_format,
+            uint8_t *sample_size)
+{
+#define FORMAT(srcfmt, dstfmt, size) case srcfmt: *pcm_format = dstfmt; *sample_size = size; break;
 	switch (format)
 	{
 	FORMAT(AUDIO_OBJECT_FORMAT_ALAW,      SND_PCM_FORMAT_A_LAW, 1)
@@ -96,32 +144,189 @@ alsa_object_open(struct audio_object *object,
 	default:                              return -EINVAL;
 	}
 #undef  FORMAT
+	return 0;
+}
+
+// Prepare the device for playback, counting the call in the object stats.
+static int
+alsa_object_prepare(struct alsa_object *self)
+{
+	audio_counter_add(&self->vtable.stats.prepares, 1);
+	return snd_pcm_prepare(self->handle);
+}
+
+static snd_pcm_uframes_t
+alsa_frames(uint32_t us, unsigned int rate)
+{
+	return (snd_pcm_uframes_t)((uint64_t)us * rate / 1000000);
+}
+
+// Set the start, wakeup and silence thresholds requested with
+// audio_object_set_thresholds, keeping the parameters to reinstall them when
+// the device is reset.
+static int
+alsa_object_set_sw_params(struct alsa_object *self,
+                          unsigned int rate)
+{
+	const struct audio_thresholds *thresholds = &self->vtable.thresholds;
+	snd_pcm_uframes_t period_frames = 0;
+	int dir = 0;
+	int err;
+
+	snd_pcm_hw_params_get_buffer_size(self->hw_params, &self->buffer_frames);
+	snd_pcm_hw_params_get_period_size(self->hw_params, &period_frames, &dir);
+	self->start_frames = self->buffer_frames;
+
+	if ((err = snd_pcm_sw_params_malloc(&self->sw_params)) < 0)
+		return err;
+	if ((err = snd_pcm_sw_params_current(self->handle, self->sw_params)) < 0)
+		return err;
+
+	if (thresholds->start_us) {
+		snd_pcm_uframes_t start = thresholds->start_us == AUDIO_OBJECT_START_IMMEDIATE
+		                        ? period_frames
+		                        : alsa_frames(thresholds->start_us, rate);
+		if (start == 0)
+			start = 1;
+		if (start > self->buffer_frames)
+			start = self->buffer_frames;
+		if ((err = snd_pcm_sw_params_set_start_threshold(self->handle, self->sw_params, start)) < 0)
+			return err;
+		self->start_frames = start;
+	}
+
+	if (thresholds->avail_min_us) {
+		snd_pcm_uframes_t avail_min = alsa_frames(thresholds->avail_min_us, rate);
+		if (avail_min == 0)
+			avail_min = 1;
+		if (avail_min > self->buffer_frames)
+			avail_min = self->buffer_frames;
+		if ((err = snd_pcm_sw_params_set_avail_min(self->handle, self->sw_params, avail_min)) < 0)
+			return err;
+	}
+
+	if (thresholds->silence_us) {
+		// Keep at least half of the buffer for the audio itself.
+		snd_pcm_uframes_t silence = alsa_frames(thresholds->silence_us, rate);
+		if (silence > self->buffer_frames / 2)
+			silence = self->buffer_frames / 2;
+		if ((err = snd_pcm_sw_params_set_silence_threshold(self->handle, self->sw_params, silence)) < 0)
+			return err;
+		if ((err = snd_pcm_sw_params_set_silence_size(self->handle, self->sw_params, silence)) < 0)
+			return err;
+	}
+
+	return snd_pcm_sw_params(self->handle, self->sw_params);
+}
+
+int
+alsa_object_open(struct audio_object *object,
+                 enum audio_object_format format,
+                 uint32_t rate,
+                 uint8_t channels)
+{
+	struct alsa_object *self = to_alsa_object(object);
+	if (self->handle)
+		return -EEXIST;
+
+	enum audio_object_format device_format = format;
+	unsigned int device_rate = rate;
+	unsigned int device_channels = channels;
+	snd_pcm_format_t pcm_format;
+	uint8_t sample_size;
+	if (alsa_format(format, &pcm_format, &sample_size) < 0)
+		return -EINVAL;
+
+	audio_pool_key_init(&self->key, object, "alsa", self->device, NULL, NULL, format, rate, channels);
+	struct alsa_handle *pooled = audio_pool_get(&self->key);
+	if (pooled) {
+		self->handle = pooled->handle;
+		self->hw_params = pooled->hw_params;
+		self->sw_params = pooled->sw_params;
+		self->pcm_format = pooled->pcm_format;
+		self->sample_size = pooled->sample_size;
+		self->mmap = pooled->mmap;
+		self->buffer_frames = pooled->buffer_frames;
+		self->start_frames = pooled->start_frames;
+		device_format = pooled->device_format;
+		device_rate = pooled->device_rate;
+		device_channels = pooled->device_channels;
+		object->negotiated = pooled->negotiated;
+		free(pooled);
+		goto opened;
+	}
 
 	snd_pcm_hw_params_t *params = NULL;
 	snd_pcm_hw_params_malloc(&params);
-	unsigned int period_time = LATENCY * 1000;
+	unsigned int period_time = object->buffering.period_us;
+	unsigned int periods = object->buffering.periods;
+	unsigned int buffer_time = object->buffering.latency_us;
 	int dir = 0;
 
+	if (!period_time && !periods && !buffer_time)
+		period_time = DEFAULT_LATENCY_US;
+
 	int err = 0;
 	if ((err = snd_pcm_open(&self->handle, self->device ? self->device : "default", SND_PCM_STREAM_PLAYBACK, 0)) < 0)
 		goto error;
 	if ((err = snd_pcm_hw_params_any(self->handle, params)) < 0)
 		goto error;
-	if ((err = snd_pcm_hw_params_set_access(self->handle, params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0)
+	// Prefer mmap access so audio_object_begin_write can hand out the device
+	// buffer; snd_pcm_mmap_writei keeps audio_object_write working with it.
+	self->mmap = snd_pcm_hw_params_set_access(self->handle, params, SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0;
+	if (!self->mmap && (err = snd_pcm_hw_params_set_access(self->handle, params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0)
 		goto error;
+	if (snd_pcm_hw_params_test_format(self->handle, params, pcm_format) < 0) {
+		// Convert to the closest format the device supports.
+		enum audio_object_format supported[AUDIO_OBJECT_FORMAT_FLOAT64BE + 1];
+		size_t count = 0;
+		for (int i = 0; i <= AUDIO_OBJECT_FORMAT_FLOAT64BE; ++i) {
+			snd_pcm_format_t test_format;
+			uint8_t test_size;
+			if (alsa_format(i, &test_format, &test_size) == 0 &&
+			    snd_pcm_hw_params_test_format(self->handle, params, test_format) == 0)
+				supported[count++] = i;
+		}
+		device_format = audio_convert_nearest(format, supported, count);
+		alsa_format(device_format, &pcm_format, &sample_size);
+	}
 	if ((err = snd_pcm_hw_params_set_format(self->handle, params, pcm_format)) < 0)
 		goto error;
-	if ((err = snd_pcm_hw_params_set_rate_near(self->handle, params, &rate, 0)) < 0)
+	// Let audio.c resample the audio when a quality level is selected,
+	// instead of also resampling in the plug layer.
+	if (object->resample_quality > AUDIO_OBJECT_RESAMPLE_NONE)
+		snd_pcm_hw_params_set_rate_resample(self->handle, params, 0);
+	if ((err = snd_pcm_hw_params_set_rate_near(self->handle, params, &device_rate, 0)) < 0)
+		goto error;
+	// Mix to the nearest number of channels the device supports.
+	if (snd_pcm_hw_params_set_channels(self->handle, params, device_channels) < 0 &&
+	    (err = snd_pcm_hw_params_set_channels_near(self->handle, params, &device_channels)) < 0)
 		goto error;
-	if ((err = snd_pcm_hw_params_set_channels(self->handle, params, channels)) < 0)
+	self->sample_size = sample_size * device_channels;
+	if (period_time && (err = snd_pcm_hw_params_set_period_time_near(self->handle, params, &period_time, &dir)) < 0)
 		goto error;
-	if ((err = snd_pcm_hw_params_set_period_time_near(self->handle, params, &period_time, &dir)) < 0)
+	if (periods && (err = snd_pcm_hw_params_set_periods_near(self->handle, params, &periods, &dir)) < 0)
+		goto error;
+	if (buffer_time && !periods && (err = snd_pcm_hw_params_set_buffer_time_near(self->handle, params, &buffer_time, &dir)) < 0)
 		goto error;
 	if ((err = snd_pcm_hw_params(self->handle, params)) < 0)
 		goto error;
-	if ((err = snd_pcm_prepare(self->handle)) < 0)
+
+	snd_pcm_hw_params_get_period_time(params, &object->negotiated.period_us, &dir);
+	snd_pcm_hw_params_get_periods(params, &object->negotiated.periods, &dir);
+	snd_pcm_hw_params_get_buffer_time(params, &object->negotiated.latency_us, &dir);
+	self->hw_params = params;
+	if ((err = alsa_object_set_sw_params(self, device_rate)) < 0)
+		goto error;
+	if ((err = alsa_object_prepare(self)) < 0)
 		goto error;
 
+	self->pcm_format = pcm_format;
+opened:
+	self->skip = 0;
+	object->device_format = device_format;
+	object->device_rate = device_rate;
+	object->device_channels = device_channels;
 	self->is_open = 1;
 	self->format = format;
 	self->rate = rate;
@@ -130,6 +335,11 @@ alsa_object_open(struct audio_object *object,
 error:
 	if (params)
 		snd_pcm_hw_params_free(params);
+	self->hw_params = NULL;
+	if (self->sw_params) {
+		snd_pcm_sw_params_free(self->sw_params);
+		self->sw_params = NULL;
+	}
 	if (self->handle) {
 		snd_pcm_close(self->handle);
 		self->handle = NULL;
@@ -138,23 +348,101 @@ error:
 	return err;
 }
 
+// Discard the queued audio, keeping the device open. Using snd_pcm_drop on
+// its own leaves audio in some plugins (such as the rate converter) that is
+// heard as an echo when playback resumes, so the negotiated hw_params are
+// installed again to reset them. That also resets the sw_params, so they are
+// installed again as well.
+static int
+alsa_object_reset(struct alsa_object *self)
+{
+	int err;
+	if (!self->handle || !self->hw_params)
+		return -EBADFD;
+	if ((err = snd_pcm_drop(self->handle)) < 0)
+		return err;
+	if ((err = snd_pcm_hw_params(self->handle, self->hw_params)) < 0)
+		return err;
+	if (self->sw_params && (err = snd_pcm_sw_params(self->handle, self->sw_params)) < 0)
+		return err;
+	return alsa_object_prepare(self);
+}
+
+// Reset the device and return it to the handle pool, keeping it open and
+// configured for the next object opened with the same parameters.
+static void
+alsa_object_pool(struct alsa_object *self)
+{
+	if (!self->handle || !self->hw_params || !audio_pool_enabled())
+		return;
+	if (alsa_object_reset(self) != 0)
+		return;
+
+	struct alsa_handle *pooled = malloc(sizeof(struct alsa_handle));
+	if (!pooled)
+		return;
+
+	pooled->handle = self->handle;
+	pooled->hw_params = self->hw_params;
+	pooled->sw_params = self->sw_params;
+	pooled->pcm_format = self->pcm_format;
+	pooled->sample_size = self->sample_size;
+	pooled->mmap = self->mmap;
+	pooled->buffer_frames = self->buffer_frames;
+	pooled->start_frames = self->start_frames;
+	pooled->device_format = self->vtable.device_format;
+	pooled->device_rate = self->vtable.device_rate;
+	pooled->device_channels = self->vtable.device_channels;
+	pooled->negotiated = self->vtable.negotiated;
+	audio_pool_put(&self->key, pooled, alsa_handle_release);
+
+	self->handle = NULL;
+	self->hw_params = NULL;
+	self->sw_params = NULL;
+}
+
 void
 alsa_object_close(struct audio_object *object)
 {
 	struct alsa_object *self = to_alsa_object(object);
 
+	alsa_object_pool(self);
 	if (self->handle) {
 		snd_pcm_close(self->handle);
 		self->handle = NULL;
-		self->is_open = 1;
+	}
+	self->is_open = 0;
+	if (self->hw_params) {
+		snd_pcm_hw_params_free(self->hw_params);
+		self->hw_params = NULL;
+	}
+	if (self->sw_params) {
+		snd_pcm_sw_params_free(self->sw_params);
+		self->sw_params = NULL;
 	}
 }
 
+void
+alsa_object_forget(struct audio_object *object)
+{
+	struct alsa_object *self = to_alsa_object(object);
+
+	// snd_pcm_close would stop the parent's device.
+	self->handle = NULL;
+	self->hw_params = NULL;
+	self->sw_params = NULL;
+	self->is_open = 0;
+}
+
 void
 alsa_object_destroy(struct audio_object *object)
 {
 	struct alsa_object *self = to_alsa_object(object);
 
+	if (self->wake[0] != -1) {
+		close(self->wake[0]);
+		close(self->wake[1]);
+	}
 	free(self->device);
 	free(self);
 }
@@ -167,27 +455,275 @@ alsa_object_drain(struct audio_object *object)
 
 	if (self->handle) {
 		snd_pcm_drain(self->handle);
-		ret = snd_pcm_prepare(self->handle);
+		ret = alsa_object_prepare(self);
 	}
 	return ret;
 }
 
+void
+alsa_object_wake(struct audio_object *object)
+{
+	struct alsa_object *self = to_alsa_object(object);
+	char c = 0;
+
+	// If the pipe is full, a wakeup is already pending.
+	if (self->wake[1] != -1 && write(self->wake[1], &c, 1) == -1)
+		return;
+}
+
+int
+alsa_object_drain_until(struct audio_object *object,
+                        uint64_t deadline,
+                        uint64_t generation)
+{
+	struct alsa_object *self = to_alsa_object(object);
+	if (!self->handle)
+		return 0;
+
+	// Wait for the buffer to empty without snd_pcm_drain, which would leave
+	// the PCM in the DRAINING state if the wait timed out or was cancelled,
+	// so the next write would fail and the audio still queued be lost. The
+	// PCM keeps running until the buffer is empty, and is only drained then.
+	struct pollfd fds[1];
+	fds[0].fd = self->wake[0];
+	fds[0].events = POLLIN;
+
+	uint32_t rate = object->device_rate ? object->device_rate : 1;
+	int period_ms = object->negotiated.period_us ? object->negotiated.period_us / 1000 + 1 : 10;
+	int err = 0;
+	for (;;) {
+		if (audio_counter_get(&object->drain_generation) != generation)
+			return -ECANCELED;
+
+		snd_pcm_state_t state = snd_pcm_state(self->handle);
+		if (state != SND_PCM_STATE_PREPARED && state != SND_PCM_STATE_RUNNING)
+			break;
+
+		snd_pcm_sframes_t avail = snd_pcm_avail_update(self->handle);
+		if (avail < 0)
+			break; // An underrun, so the audio has been played.
+		if ((snd_pcm_uframes_t)avail >= self->buffer_frames)
+			break;
+
+		// Start a device that is below its start threshold.
+		if (state == SND_PCM_STATE_PREPARED && (err = snd_pcm_start(self->handle)) < 0)
+			return err;
+
+		int wait = audio_drain_remaining(deadline);
+		if (wait == 0)
+			return -ETIMEDOUT;
+
+		// Sleep until the buffer should be empty, checking at least every
+		// period in case the device is slower than its rate.
+		int queued_ms = (int)((uint64_t)(self->buffer_frames - avail) * 1000 / rate) + 1;
+		if (queued_ms > period_ms)
+			queued_ms = period_ms;
+		if (wait < 0 || wait > queued_ms)
+			wait = queued_ms;
+
+		int n = poll(fds, 1, wait);
+		if (n < 0 && errno != EINTR)
+			return -errno;
+		if (n > 0 && (fds[0].revents & POLLIN)) {
+			char buffer[16];
+			while (read(self->wake[0], buffer, sizeof(buffer)) > 0)
+				;
+		}
+	}
+
+	// The buffer is empty, so this only waits for the device to stop.
+	snd_pcm_drain(self->handle);
+	return alsa_object_prepare(self);
+}
+
 int
 alsa_object_flush(struct audio_object *object)
 {
 	struct alsa_object *self = to_alsa_object(object);
 	if (!self) return 0;
 
-	// Using snd_pcm_drop does not discard the audio, so reopen the device
-	// to reset the sound buffer.
 	if (self->is_open) {
-		audio_object_close(object);
-		return audio_object_open(object, self->format, self->rate, self->channels);
+		int err = alsa_object_reset(self);
+		if (err == 0)
+			return 0;
+
+		// The device could not be reset, so reopen it.
+		AUDIO_PROBE2(alsa_flush_reopen, object, err);
+		alsa_object_close(object);
+		return alsa_object_open(object, self->format, self->rate, self->channels);
 	}
 
 	return 0;
 }
 
+static uint64_t
+alsa_time_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// The frames that would have been played since the device stopped, for
+// AUDIO_OBJECT_XRUN_SKIP.
+static snd_pcm_uframes_t
+alsa_object_stopped_frames(struct alsa_object *self)
+{
+	snd_pcm_status_t *status;
+	snd_htimestamp_t now, stopped;
+
+	snd_pcm_status_alloca(&status);
+	if (snd_pcm_status(self->handle, status) < 0)
+		return 0;
+	snd_pcm_status_get_htstamp(status, &now);
+	snd_pcm_status_get_trigger_htstamp(status, &stopped);
+
+	int64_t ns = (int64_t)(now.tv_sec - stopped.tv_sec) * 1000000000 + now.tv_nsec - stopped.tv_nsec;
+	return ns > 0 ? (uint64_t)ns * self->vtable.device_rate / 1000000000 : 0;
+}
+
+// Write a period of silence, for AUDIO_OBJECT_XRUN_PRIME.
+static int
+alsa_object_prime(struct alsa_object *self)
+{
+	snd_pcm_uframes_t frames = 0;
+	int dir = 0;
+	if (snd_pcm_hw_params_get_period_size(self->hw_params, &frames, &dir) < 0 || frames == 0)
+		return 0;
+
+	void *silence = malloc(frames * self->sample_size);
+	if (!silence)
+		return -ENOMEM;
+	snd_pcm_format_set_silence(self->pcm_format, silence, frames * self->vtable.device_channels);
+	snd_pcm_sframes_t written = self->mmap
+	                          ? snd_pcm_mmap_writei(self->handle, silence, frames)
+	                          : snd_pcm_writei(self->handle, silence, frames);
+	free(silence);
+	return written < 0 ? (int)written : 0;
+}
+
+// Resume a suspended device without blocking the writer for long. The wait
+// is on the wake pipe, so a flush gives up on the resume straight away.
+static int
+alsa_object_resume(struct alsa_object *self)
+{
+	uint64_t deadline = audio_drain_deadline(RESUME_TIMEOUT_MS);
+	int wait = 1;
+	int err;
+	while ((err = snd_pcm_resume(self->handle)) == -EAGAIN) {
+		int remaining = audio_drain_remaining(deadline);
+		if (remaining == 0)
+			break;
+
+		struct pollfd fd = { self->wake[0], POLLIN, 0 };
+		if (poll(&fd, self->wake[0] != -1 ? 1 : 0, wait < remaining ? wait : remaining) > 0) {
+			char buffer[16];
+			while (read(self->wake[0], buffer, sizeof(buffer)) > 0)
+				;
+			break;
+		}
+		if (wait < RESUME_MAX_WAIT_MS)
+			wait *= 2;
+	}
+	AUDIO_PROBE2(alsa_resume, &self->vtable, err);
+	if (err == -ENOSYS || err == -EAGAIN) {
+		// The hardware does not support resuming, or is taking too long,
+		// so start again from a prepared state.
+		err = alsa_object_prepare(self);
+		AUDIO_PROBE2(alsa_resume_prepare, &self->vtable, err);
+	}
+	return err;
+}
+
+// Recover from an error returned by a write to the device, returning 0 if
+// the write can be retried.
+static int
+alsa_object_recover(struct alsa_object *self, int err)
+{
+	struct audio_object *object = &self->vtable;
+	enum audio_object_xrun_type type;
+	uint64_t start = alsa_time_us();
+	int ret;
+
+	if ((err == -EPIPE)
+#ifdef EBADFD
+	    || (err == -EBADFD)
+#endif
+	    ) {
+		// Either there was an underrun or the PCM was in a bad state.
+		type = AUDIO_OBJECT_XRUN_UNDERRUN;
+		audio_counter_add(&object->stats.underruns, 1);
+		if (object->xrun_policy == AUDIO_OBJECT_XRUN_SKIP && err == -EPIPE)
+			self->skip = alsa_object_stopped_frames(self);
+		ret = alsa_object_prepare(self);
+		AUDIO_PROBE3(alsa_xrun, object, err, ret);
+	}
+#ifdef ESTRPIPE
+	else if (err == -ESTRPIPE) {
+		// Sound suspended, try to resume.
+		type = AUDIO_OBJECT_XRUN_SUSPEND;
+		audio_counter_add(&object->stats.suspends, 1);
+		if (object->xrun_policy == AUDIO_OBJECT_XRUN_SKIP)
+			self->skip = alsa_object_stopped_frames(self);
+		ret = alsa_object_resume(self);
+	}
+#endif
+	else {
+		AUDIO_PROBE2(alsa_error, object, err);
+		return err;
+	}
+
+	if (ret == 0 && object->xrun_policy == AUDIO_OBJECT_XRUN_PRIME)
+		ret = alsa_object_prime(self);
+	audio_xrun(object, type, ret, alsa_time_us() - start);
+	if (ret == 0 && object->xrun_policy == AUDIO_OBJECT_XRUN_FAIL)
+		return err;
+	return ret;
+}
+
+// Wait for space in the buffer, starting the device if it is full but has
+// not been started. The wait is on the wake pipe as well as the PCM, so a
+// flush from another thread cancels it without waiting for a period to play.
+static int
+alsa_object_wait(struct alsa_object *self)
+{
+	if (snd_pcm_state(self->handle) == SND_PCM_STATE_PREPARED)
+		return snd_pcm_start(self->handle);
+
+	struct pollfd fds[MAX_POLL_FDS + 1];
+	int count = snd_pcm_poll_descriptors(self->handle, fds + 1, MAX_POLL_FDS);
+	if (count < 0)
+		return count;
+	fds[0].fd = self->wake[0];
+	fds[0].events = POLLIN;
+
+	for (;;) {
+		if (audio_write_cancelled(&self->vtable))
+			return -ECANCELED;
+
+		int n = poll(fds, count + 1, -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (fds[0].revents & POLLIN) {
+			char buffer[16];
+			while (read(self->wake[0], buffer, sizeof(buffer)) > 0)
+				;
+			continue;
+		}
+
+		unsigned short revents = 0;
+		int err = snd_pcm_poll_descriptors_revents(self->handle, fds + 1, count, &revents);
+		if (err < 0)
+			return err;
+		// On an error, the next write reports what went wrong.
+		if (revents & (POLLOUT | POLLERR))
+			return 0;
+	}
+}
+
 int
 alsa_object_write(struct audio_object *object,
                   const void *data,
@@ -202,40 +738,52 @@ alsa_object_write(struct audio_object *object,
 	snd_pcm_sframes_t nWritten = 0; // And number alsa actually wrote.
 
 	while (1) {
-		nWritten = snd_pcm_writei(self->handle, data, nToWrite);
-		if ((nWritten >= 0) && (nWritten < nToWrite)) {
+		if (self->skip) {
+			// Drop the audio that would have played during an xrun.
+			snd_pcm_uframes_t skip = self->skip < nToWrite ? self->skip : nToWrite;
+			self->skip -= skip;
+			nToWrite -= skip;
+			data += skip * self->sample_size;
+			if (nToWrite == 0)
+				break;
+		}
+
+		// Only write what fits in the buffer, so the write does not block
+		// in ALSA where a flush cannot interrupt it.
+		snd_pcm_sframes_t avail = snd_pcm_avail_update(self->handle);
+		if (avail == 0) {
+			if ((err = alsa_object_wait(self)) == -ECANCELED)
+				break;
+			if (err < 0 && (err = alsa_object_recover(self, err)) < 0)
+				break;
+			continue;
+		}
+		if (avail < 0) {
+			if ((err = alsa_object_recover(self, avail)) < 0)
+				break;
+			continue;
+		}
+		snd_pcm_uframes_t count = (snd_pcm_uframes_t)avail < nToWrite ? (snd_pcm_uframes_t)avail : nToWrite;
+
+		if (self->mmap)
+			nWritten = snd_pcm_mmap_writei(self->handle, data, count);
+		else
+			nWritten = snd_pcm_writei(self->handle, data, count);
+		if ((nWritten >= 0) && (nWritten < count)) {
 			// Can happen in case of a signal or underrun.
+			audio_counter_add(&object->stats.short_writes, 1);
+			AUDIO_PROBE3(alsa_short_write, object, nWritten, count);
 			nToWrite -= nWritten;
 			data += nWritten * self->sample_size;
 			// Open question: if a signal caused the short read, should we snd_pcm_prepare?
-		} else if ((nWritten == -EPIPE)
-#ifdef EBADFD
-		    || (nWritten == -EBADFD)
-#endif
-		    ) {
-			// Either there was an underrun or the PCM was in a bad state.
-			err = snd_pcm_prepare(self->handle);
-			if (err != 0)
-				break;
-		}
-#ifdef ESTRPIPE
-		else if (nWritten == -ESTRPIPE) {
-			// Sound suspended, try to resume.
-			do {
-				err = snd_pcm_resume(self->handle);
-				sleep(1);
-			} while (err == -EAGAIN);
-			if (err == -ENOSYS) {
-				// Hardware doesn't support "fine resume".
-				// So just prepare.
-				err = snd_pcm_prepare(self->handle);
-			}
-			if (err < 0) {
+		} else if (nWritten < 0) {
+			err = alsa_object_recover(self, nWritten);
+			if (err < 0)
 				break;
-			}
-		}
-#endif
-		else {
+		} else if (nWritten < nToWrite) {
+			nToWrite -= nWritten;
+			data += nWritten * self->sample_size;
+		} else {
 			err = nWritten;
 			break;
 		}
@@ -244,6 +792,158 @@ alsa_object_write(struct audio_object *object,
 	return err >= 0 ? 0 : err;
 }
 
+int
+alsa_object_begin_write(struct audio_object *object,
+                        void **data,
+                        size_t *frames)
+{
+	struct alsa_object *self = to_alsa_object(object);
+	if (!self->handle)
+		return -EBADFD;
+	if (!self->mmap)
+		return -ENOSYS;
+
+	snd_pcm_sframes_t avail;
+	int err;
+	while ((avail = snd_pcm_avail_update(self->handle)) <= 0) {
+		if (avail == 0) {
+			// The buffer is full, so start playing if that has not
+			// happened yet and wait for space.
+			if (snd_pcm_state(self->handle) == SND_PCM_STATE_PREPARED)
+				err = snd_pcm_start(self->handle);
+			else
+				err = snd_pcm_wait(self->handle, -1);
+			if (err >= 0)
+				continue;
+			avail = err;
+		}
+		if ((err = alsa_object_recover(self, avail)) < 0)
+			return err;
+	}
+
+	const snd_pcm_channel_area_t *areas;
+	snd_pcm_uframes_t count = (*frames != 0 && *frames < avail) ? *frames : avail;
+	if ((err = snd_pcm_mmap_begin(self->handle, &areas, &self->mmap_offset, &count)) < 0)
+		return err;
+
+	*data = (char *)areas[0].addr + (areas[0].first + self->mmap_offset * areas[0].step) / 8;
+	*frames = count;
+	return 0;
+}
+
+int
+alsa_object_commit(struct audio_object *object,
+                   size_t frames)
+{
+	struct alsa_object *self = to_alsa_object(object);
+	if (!self->handle)
+		return -EBADFD;
+
+	snd_pcm_sframes_t committed = snd_pcm_mmap_commit(self->handle, self->mmap_offset, frames);
+	if (committed < 0) {
+		// The frames were not queued even if the device was recovered, so
+		// report the error for the caller to render them again.
+		int err = alsa_object_recover(self, committed);
+		return err < 0 ? err : (int)committed;
+	}
+	if ((size_t)committed < frames) {
+		audio_counter_add(&object->stats.short_writes, 1);
+		AUDIO_PROBE3(alsa_short_write, object, committed, frames);
+		return -EPIPE;
+	}
+
+	// Match snd_pcm_mmap_writei, which starts the device once the start
+	// threshold has been reached.
+	if (snd_pcm_state(self->handle) == SND_PCM_STATE_PREPARED) {
+		snd_pcm_sframes_t avail = snd_pcm_avail_update(self->handle);
+		if (avail >= 0 && self->buffer_frames - avail >= self->start_frames)
+			return snd_pcm_start(self->handle);
+	}
+	return 0;
+}
+
+int
+alsa_object_delay(struct audio_object *object,
+                  size_t *frames)
+{
+	struct alsa_object *self = to_alsa_object(object);
+	snd_pcm_sframes_t delay = 0;
+	int err = 0;
+
+	if (self->handle) {
+		switch (snd_pcm_state(self->handle))
+		{
+		case SND_PCM_STATE_PREPARED:
+		case SND_PCM_STATE_RUNNING:
+		case SND_PCM_STATE_DRAINING:
+			err = snd_pcm_delay(self->handle, &delay);
+			break;
+		default:
+			break;
+		}
+	}
+	*frames = delay > 0 ? delay : 0;
+	return err;
+}
+
+int
+alsa_object_get_pollfds(struct audio_object *object,
+                        struct audio_object_pollfd *fds,
+                        unsigned int space)
+{
+	struct alsa_object *self = to_alsa_object(object);
+	if (!self->handle)
+		return -EBADFD;
+
+	int count = snd_pcm_poll_descriptors_count(self->handle);
+	if (count <= 0 || space == 0)
+		return count;
+
+	struct pollfd pfds[MAX_POLL_FDS];
+	count = snd_pcm_poll_descriptors(self->handle, pfds, space < MAX_POLL_FDS ? space : MAX_POLL_FDS);
+	for (int i = 0; i < count; ++i) {
+		fds[i].fd = pfds[i].fd;
+		fds[i].events = pfds[i].events;
+		fds[i].revents = 0;
+	}
+	return count;
+}
+
+int
+alsa_object_service(struct audio_object *object,
+                    const struct audio_object_pollfd *fds,
+                    unsigned int nfds,
+                    size_t *frames)
+{
+	struct alsa_object *self = to_alsa_object(object);
+	if (!self->handle)
+		return -EBADFD;
+
+	// The plugins need to see the events, e.g. to acknowledge dmix timers.
+	struct pollfd pfds[MAX_POLL_FDS];
+	unsigned short revents = 0;
+	if (nfds > MAX_POLL_FDS)
+		nfds = MAX_POLL_FDS;
+	for (unsigned int i = 0; i < nfds; ++i) {
+		pfds[i].fd = fds[i].fd;
+		pfds[i].events = fds[i].events;
+		pfds[i].revents = fds[i].revents;
+	}
+	int err;
+	if (nfds && (err = snd_pcm_poll_descriptors_revents(self->handle, pfds, nfds, &revents)) < 0)
+		return err;
+
+	snd_pcm_sframes_t avail = snd_pcm_avail_update(self->handle);
+	if (avail < 0) {
+		if ((err = alsa_object_recover(self, avail)) < 0)
+			return err;
+		if ((avail = snd_pcm_avail_update(self->handle)) < 0)
+			return avail;
+	}
+	*frames = avail;
+	return 0;
+}
+
 const char *
 alsa_object_strerror(struct audio_object *object,
                      int error)
@@ -256,7 +956,7 @@ create_alsa_object(const char *device,
                    const char *application_name,
                    const char *description)
 {
-	struct alsa_object *self = malloc(sizeof(struct alsa_object));
+	struct alsa_object *self = calloc(1, sizeof(struct alsa_object));
 	if (!self)
 		return NULL;
 
@@ -264,14 +964,29 @@ create_alsa_object(const char *device,
 	self->sample_size = 0;
 	self->device = device ? strdup(device) : NULL;
 	self->is_open = 0;
+	if (pipe(self->wake) == 0) {
+		for (int i = 0; i < 2; ++i) {
+			fcntl(self->wake[i], F_SETFL, O_NONBLOCK);
+			fcntl(self->wake[i], F_SETFD, FD_CLOEXEC);
+		}
+	} else
+		self->wake[0] = self->wake[1] = -1;
 
 	self->vtable.open = alsa_object_open;
 	self->vtable.close = alsa_object_close;
+	self->vtable.forget = alsa_object_forget;
 	self->vtable.destroy = alsa_object_destroy;
 	self->vtable.write = alsa_object_write;
 	self->vtable.drain = alsa_object_drain;
 	self->vtable.flush = alsa_object_flush;
 	self->vtable.strerror = alsa_object_strerror;
+	self->vtable.begin_write = alsa_object_begin_write;
+	self->vtable.commit = alsa_object_commit;
+	self->vtable.delay = alsa_object_delay;
+	self->vtable.drain_until = alsa_object_drain_until;
+	self->vtable.wake = alsa_object_wake;
+	self->vtable.get_pollfds = alsa_object_get_pollfds;
+	self->vtable.service = alsa_object_service;
 
 	return &self->vtable;
 }
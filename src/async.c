@@ -0,0 +1,518 @@
+/* Asynchronous Write Queue.
+ *
+ * Copyright (C) 2026 Reece H. Dunn
+ *
+ * This file is part of pcaudiolib.
+ *
+ * pcaudiolib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pcaudiolib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pcaudiolib.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "audio_priv.h"
+
+#include <errno.h>
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_STDATOMIC_H)
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+struct audio_async_request
+{
+	const void *data;
+	size_t bytes;
+	void *copy;
+	unsigned int generation;
+	int drain;
+	uint64_t drain_generation;
+	audio_object_write_callback callback;
+	void *userdata;
+};
+
+struct audio_async_entry
+{
+	atomic_size_t sequence;
+	atomic_int drain; // request.drain, readable before the entry is popped
+	struct audio_async_request request;
+};
+
+/* The queue is a bounded multi-producer/multi-consumer ring where each slot
+ * carries a sequence number (Dmitry Vyukov's algorithm), so producers and the
+ * feeder thread only synchronize through atomics. The mutex and condition are
+ * only used to put threads to sleep when the queue is empty or full.
+ */
+struct audio_async
+{
+	struct audio_object *object;
+	struct audio_async_entry *entries;
+	size_t mask;
+	atomic_size_t enqueue_pos;
+	atomic_size_t dequeue_pos;
+	enum audio_object_async_policy policy;
+
+	atomic_size_t pending;
+	atomic_uint generation;
+	atomic_int busy;
+	atomic_int stop;
+
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	atomic_int waiting;
+};
+
+static int
+async_push(struct audio_async *async, const struct audio_async_request *request)
+{
+	struct audio_async_entry *entry;
+	size_t pos = atomic_load_explicit(&async->enqueue_pos, memory_order_relaxed);
+	for (;;) {
+		entry = &async->entries[pos & async->mask];
+		size_t seq = atomic_load_explicit(&entry->sequence, memory_order_acquire);
+		intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(&async->enqueue_pos, &pos, pos + 1,
+			                                          memory_order_relaxed, memory_order_relaxed))
+				break;
+		} else if (diff < 0)
+			return 0; // The queue is full.
+		else
+			pos = atomic_load_explicit(&async->enqueue_pos, memory_order_relaxed);
+	}
+
+	entry->request = *request;
+	atomic_store_explicit(&entry->drain, request->drain, memory_order_relaxed);
+	atomic_store(&entry->sequence, pos + 1);
+	return 1;
+}
+
+/* Remove the oldest request. If writes_only is set, a drain at the front of
+ * the queue is left there and 0 is returned, as its caller relies on it
+ * being performed. */
+static int
+async_pop(struct audio_async *async, struct audio_async_request *request, int writes_only)
+{
+	struct audio_async_entry *entry;
+	size_t pos = atomic_load_explicit(&async->dequeue_pos, memory_order_relaxed);
+	for (;;) {
+		entry = &async->entries[pos & async->mask];
+		size_t seq = atomic_load_explicit(&entry->sequence, memory_order_acquire);
+		intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+		if (diff == 0) {
+			if (writes_only && atomic_load_explicit(&entry->drain, memory_order_relaxed))
+				return 0;
+			if (atomic_compare_exchange_weak_explicit(&async->dequeue_pos, &pos, pos + 1,
+			                                          memory_order_relaxed, memory_order_relaxed))
+				break;
+		} else if (diff < 0)
+			return 0; // The queue is empty.
+		else
+			pos = atomic_load_explicit(&async->dequeue_pos, memory_order_relaxed);
+	}
+
+	*request = entry->request;
+	atomic_store(&entry->sequence, pos + async->mask + 1);
+	return 1;
+}
+
+static int
+async_has_space(struct audio_async *async)
+{
+	size_t pos = atomic_load(&async->enqueue_pos);
+	return atomic_load(&async->entries[pos & async->mask].sequence) == pos;
+}
+
+static int
+async_has_data(struct audio_async *async)
+{
+	size_t pos = atomic_load(&async->dequeue_pos);
+	return atomic_load(&async->entries[pos & async->mask].sequence) == pos + 1;
+}
+
+static size_t
+async_length(size_t queue_length)
+{
+	size_t length = 2;
+	while (length < queue_length)
+		length <<= 1;
+	return length;
+}
+
+static int
+async_is_idle(struct audio_async *async)
+{
+	return !async_has_data(async) && !atomic_load(&async->busy);
+}
+
+static int
+async_feeder_ready(struct audio_async *async)
+{
+	return atomic_load(&async->stop) || async_has_data(async);
+}
+
+// Sleepers register in `waiting` before checking their condition, and state
+// changes are published before `waiting` is read, so a wakeup is never lost.
+static void
+async_sleep_until(struct audio_async *async, int (*ready)(struct audio_async *))
+{
+	pthread_mutex_lock(&async->mutex);
+	atomic_fetch_add(&async->waiting, 1);
+	while (!ready(async))
+		pthread_cond_wait(&async->cond, &async->mutex);
+	atomic_fetch_sub(&async->waiting, 1);
+	pthread_mutex_unlock(&async->mutex);
+}
+
+static void
+async_wake(struct audio_async *async)
+{
+	if (atomic_load(&async->waiting) == 0)
+		return;
+	pthread_mutex_lock(&async->mutex);
+	pthread_cond_broadcast(&async->cond);
+	pthread_mutex_unlock(&async->mutex);
+}
+
+static void
+async_complete(struct audio_async *async, struct audio_async_request *request, size_t remaining, int status)
+{
+	atomic_fetch_sub(&async->pending, remaining);
+	if (request->callback)
+		request->callback(async->object, request->data, request->bytes, status, request->userdata);
+	free(request->copy);
+}
+
+static void
+async_write(struct audio_async *async, struct audio_async_request *request)
+{
+	struct audio_object *object = async->object;
+	const char *data = request->copy ? request->copy : request->data;
+	size_t remaining = request->bytes;
+	int error = 0;
+
+	// Write in chunks of about 20ms so a flush does not need to wait for the
+	// whole buffer to be accepted by the device.
+	size_t chunk = object->frame_size * (object->rate / 50);
+	if (chunk == 0)
+		chunk = remaining;
+
+	while (remaining > 0) {
+		if (request->generation != atomic_load(&async->generation)) {
+			error = -ECANCELED;
+			break;
+		}
+
+		size_t bytes = remaining < chunk ? remaining : chunk;
+		if ((error = audio_write(object, data, bytes)) != 0)
+			break;
+		atomic_fetch_sub(&async->pending, bytes);
+		data += bytes;
+		remaining -= bytes;
+	}
+	async_complete(async, request, remaining, error);
+}
+
+static void *
+async_feeder(void *arg)
+{
+	struct audio_async *async = arg;
+	struct audio_async_request request;
+
+	while (!atomic_load(&async->stop)) {
+		atomic_store(&async->busy, 1);
+		if (!async_pop(async, &request, 0)) {
+			atomic_store(&async->busy, 0);
+			async_wake(async);
+			async_sleep_until(async, async_feeder_ready);
+			continue;
+		}
+		async_wake(async);
+
+		// Requests queued before a flush are completed here rather than by
+		// the flushing thread, so the callbacks are called from this thread.
+		if (request.generation != atomic_load(&async->generation))
+			async_complete(async, &request, request.drain ? 0 : request.bytes, -ECANCELED);
+		else if (request.drain)
+			async_complete(async, &request, 0, audio_drain(async->object, UINT64_MAX, request.drain_generation));
+		else
+			async_write(async, &request);
+		atomic_store(&async->busy, 0);
+		async_wake(async);
+	}
+	return NULL;
+}
+
+int
+audio_async_create(struct audio_object *object,
+                   size_t queue_length,
+                   enum audio_object_async_policy policy)
+{
+	size_t length = async_length(queue_length);
+	if (object->async) {
+		if (object->async->mask + 1 == length) {
+			object->async->policy = policy;
+			return 0;
+		}
+		audio_async_wait(object);
+		audio_async_destroy(object);
+	}
+
+	struct audio_async *async = calloc(1, sizeof(struct audio_async));
+	if (!async)
+		return -ENOMEM;
+
+	async->entries = calloc(length, sizeof(struct audio_async_entry));
+	if (!async->entries) {
+		free(async);
+		return -ENOMEM;
+	}
+
+	for (size_t i = 0; i < length; ++i) {
+		atomic_init(&async->entries[i].sequence, i);
+		atomic_init(&async->entries[i].drain, 0);
+	}
+	async->mask = length - 1;
+	async->object = object;
+	async->policy = policy;
+
+	pthread_mutex_init(&async->mutex, NULL);
+	pthread_cond_init(&async->cond, NULL);
+	int error = pthread_create(&async->thread, NULL, async_feeder, async);
+	if (error != 0) {
+		pthread_cond_destroy(&async->cond);
+		pthread_mutex_destroy(&async->mutex);
+		free(async->entries);
+		free(async);
+		return -error;
+	}
+
+	object->async = async;
+	return 0;
+}
+
+void
+audio_async_destroy(struct audio_object *object)
+{
+	struct audio_async *async = object->async;
+	if (!async)
+		return;
+
+	audio_async_flush(object);
+
+	atomic_store(&async->stop, 1);
+	pthread_mutex_lock(&async->mutex);
+	pthread_cond_broadcast(&async->cond);
+	pthread_mutex_unlock(&async->mutex);
+	pthread_join(async->thread, NULL);
+
+	pthread_cond_destroy(&async->cond);
+	pthread_mutex_destroy(&async->mutex);
+	free(async->entries);
+	free(async);
+	object->async = NULL;
+}
+
+int
+audio_async_write(struct audio_object *object,
+                  const void *data,
+                  size_t bytes,
+                  int flags,
+                  audio_object_write_callback callback,
+                  void *userdata)
+{
+	struct audio_async *async = object->async;
+	struct audio_async_request request;
+	struct audio_async_request dropped;
+
+	request.data = data;
+	request.bytes = bytes;
+	request.copy = NULL;
+	request.drain = 0;
+	request.callback = callback;
+	request.userdata = userdata;
+	if (flags & AUDIO_OBJECT_ASYNC_COPY) {
+		request.copy = malloc(bytes);
+		if (!request.copy)
+			return -ENOMEM;
+		memcpy(request.copy, data, bytes);
+	}
+	request.generation = atomic_load(&async->generation);
+
+	atomic_fetch_add(&async->pending, bytes);
+	while (!async_push(async, &request)) {
+		switch (async->policy)
+		{
+		case AUDIO_OBJECT_ASYNC_FAIL:
+			atomic_fetch_sub(&async->pending, bytes);
+			free(request.copy);
+			return -EAGAIN;
+		case AUDIO_OBJECT_ASYNC_DROP_OLDEST:
+			if (async_pop(async, &dropped, 1))
+				async_complete(async, &dropped, dropped.bytes, -ENOBUFS);
+			else
+				async_sleep_until(async, async_has_space); // a drain is next
+			break;
+		default:
+			async_sleep_until(async, async_has_space);
+			break;
+		}
+	}
+
+	async_wake(async);
+	return 0;
+}
+
+void
+audio_async_wait(struct audio_object *object)
+{
+	if (object->async)
+		async_sleep_until(object->async, async_is_idle);
+}
+
+int
+audio_async_wait_until(struct audio_object *object,
+                       uint64_t deadline)
+{
+	struct audio_async *async = object->async;
+	if (!async)
+		return 0;
+	if (deadline == UINT64_MAX) {
+		async_sleep_until(async, async_is_idle);
+		return 0;
+	}
+
+	int error = 0;
+	pthread_mutex_lock(&async->mutex);
+	atomic_fetch_add(&async->waiting, 1);
+	while (!async_is_idle(async)) {
+		if (audio_drain_remaining(deadline) == 0) {
+			error = -ETIMEDOUT;
+			break;
+		}
+
+		struct timespec ts;
+		audio_drain_abstime(deadline, &ts);
+		pthread_cond_timedwait(&async->cond, &async->mutex, &ts);
+	}
+	atomic_fetch_sub(&async->waiting, 1);
+	pthread_mutex_unlock(&async->mutex);
+	return error;
+}
+
+int
+audio_async_drain(struct audio_object *object,
+                  audio_object_write_callback callback,
+                  void *userdata)
+{
+	struct audio_async *async = object->async;
+	struct audio_async_request request;
+
+	memset(&request, 0, sizeof(request));
+	request.drain = 1;
+	request.drain_generation = audio_counter_get(&object->drain_generation);
+	request.generation = atomic_load(&async->generation);
+	request.callback = callback;
+	request.userdata = userdata;
+
+	// Wait for space whatever the queue policy, as the caller is relying on
+	// the callback to know when the audio has been played.
+	while (!async_push(async, &request))
+		async_sleep_until(async, async_has_space);
+
+	async_wake(async);
+	return 0;
+}
+
+void
+audio_async_flush(struct audio_object *object)
+{
+	struct audio_async *async = object->async;
+	if (!async)
+		return;
+
+	// The feeder completes the queued requests with -ECANCELED. A flush from
+	// a callback is on the feeder thread, which does that once it returns.
+	atomic_fetch_add(&async->generation, 1);
+	async_wake(async);
+	if (!pthread_equal(pthread_self(), async->thread))
+		async_sleep_until(async, async_is_idle);
+}
+
+size_t
+audio_async_pending(struct audio_object *object)
+{
+	return object->async ? atomic_load(&object->async->pending) : 0;
+}
+
+#else
+
+int
+audio_async_create(struct audio_object *object,
+                   size_t queue_length,
+                   enum audio_object_async_policy policy)
+{
+	return -ENOSYS;
+}
+
+void
+audio_async_destroy(struct audio_object *object)
+{
+}
+
+int
+audio_async_write(struct audio_object *object,
+                  const void *data,
+                  size_t bytes,
+                  int flags,
+                  audio_object_write_callback callback,
+                  void *userdata)
+{
+	return -ENOSYS;
+}
+
+void
+audio_async_wait(struct audio_object *object)
+{
+}
+
+void
+audio_async_flush(struct audio_object *object)
+{
+}
+
+int
+audio_async_wait_until(struct audio_object *object,
+                       uint64_t deadline)
+{
+	return 0;
+}
+
+int
+audio_async_drain(struct audio_object *object,
+                  audio_object_write_callback callback,
+                  void *userdata)
+{
+	return -ENOSYS;
+}
+
+size_t
+audio_async_pending(struct audio_object *object)
+{
+	return 0;
+}
+
+#endif
@@ -20,6 +20,111 @@
 
 #include "config.h"
 #include "audio_priv.h"
+#include "trace.h"
+
+#include <errno.h>
+#include <string.h>
+#ifdef HAVE_CLOCK_GETTIME
+#include <time.h>
+#endif
+
+/* Number of buffers queued by audio_object_write_async when the queue has not
+ * been configured with audio_object_set_async. */
+#define DEFAULT_ASYNC_QUEUE_LENGTH 16
+
+/* Number of frames returned by audio_object_begin_write for the staging
+ * buffer when the caller does not ask for a specific number (20ms). */
+#define DEFAULT_STAGING_FRAMES(rate) ((rate) / 50)
+
+size_t
+audio_object_format_size(enum audio_object_format format)
+{
+	switch (format)
+	{
+	case AUDIO_OBJECT_FORMAT_S16LE:
+	case AUDIO_OBJECT_FORMAT_S16BE:
+	case AUDIO_OBJECT_FORMAT_U16LE:
+	case AUDIO_OBJECT_FORMAT_U16BE:
+		return 2;
+	case AUDIO_OBJECT_FORMAT_S18LE:
+	case AUDIO_OBJECT_FORMAT_S18BE:
+	case AUDIO_OBJECT_FORMAT_U18LE:
+	case AUDIO_OBJECT_FORMAT_U18BE:
+	case AUDIO_OBJECT_FORMAT_S20LE:
+	case AUDIO_OBJECT_FORMAT_S20BE:
+	case AUDIO_OBJECT_FORMAT_U20LE:
+	case AUDIO_OBJECT_FORMAT_U20BE:
+	case AUDIO_OBJECT_FORMAT_S24LE:
+	case AUDIO_OBJECT_FORMAT_S24BE:
+	case AUDIO_OBJECT_FORMAT_U24LE:
+	case AUDIO_OBJECT_FORMAT_U24BE:
+		return 3;
+	case AUDIO_OBJECT_FORMAT_S24_32LE:
+	case AUDIO_OBJECT_FORMAT_S24_32BE:
+	case AUDIO_OBJECT_FORMAT_U24_32LE:
+	case AUDIO_OBJECT_FORMAT_U24_32BE:
+	case AUDIO_OBJECT_FORMAT_S32LE:
+	case AUDIO_OBJECT_FORMAT_S32BE:
+	case AUDIO_OBJECT_FORMAT_U32LE:
+	case AUDIO_OBJECT_FORMAT_U32BE:
+	case AUDIO_OBJECT_FORMAT_FLOAT32LE:
+	case AUDIO_OBJECT_FORMAT_FLOAT32BE:
+		return 4;
+	case AUDIO_OBJECT_FORMAT_FLOAT64LE:
+	case AUDIO_OBJECT_FORMAT_FLOAT64BE:
+		return 8;
+	default:
+		return 1;
+	}
+}
+
+static int
+audio_open(struct audio_object *object,
+           enum audio_object_format format,
+           uint32_t rate,
+           uint8_t channels)
+{
+	memset(&object->negotiated, 0, sizeof(object->negotiated));
+	uint8_t device_channels = channels;
+	const float *matrix = NULL;
+	if (object->channel_map.out_channels && object->channel_map.in_channels == channels) {
+		device_channels = object->channel_map.out_channels;
+		matrix = object->channel_map.matrix;
+	}
+
+	object->device_format = format;
+	object->device_rate = rate;
+	object->device_channels = device_channels;
+	int error = object->open(object, format, rate, device_channels);
+	if (error != 0)
+		return error;
+
+	object->format = format;
+	object->rate = rate;
+	object->channels = channels;
+	object->frame_size = audio_object_format_size(format) * channels;
+	audio_counter_set(&object->written_frames, 0);
+
+	// The backend opened the device with a different format, rate or number
+	// of channels.
+	audio_convert_destroy(object->convert);
+	object->convert = NULL;
+	uint32_t device_rate = rate;
+	if (object->resample_quality != AUDIO_OBJECT_RESAMPLE_NONE)
+		device_rate = object->device_rate;
+	if (object->device_channels != device_channels)
+		matrix = NULL;
+	if (object->device_format != format || device_rate != rate || object->device_channels != channels || matrix) {
+		object->convert = audio_convert_create(format, rate, channels,
+		                                       object->device_format, device_rate, object->device_channels,
+		                                       matrix, object->resample_quality);
+		if (!object->convert) {
+			object->close(object);
+			return -EINVAL;
+		}
+	}
+	return 0;
+}
 
 int
 audio_object_open(struct audio_object *object,
@@ -27,23 +132,67 @@ audio_object_open(struct audio_object *object,
                   uint32_t rate,
                   uint8_t channels)
 {
-	if (object)
-		return object->open(object, format, rate, channels);
-	return 0;
+	if (!object)
+		return 0;
+
+	AUDIO_PROBE4(open_entry, object, format, rate, channels);
+	int error = 0;
+	if (audio_standby_resume(object, format, rate, channels))
+		audio_counter_set(&object->written_frames, 0);
+	else
+		error = audio_open(object, format, rate, channels);
+	AUDIO_PROBE2(open_return, object, error);
+	return error;
+}
+
+void
+audio_close(struct audio_object *object)
+{
+	object->close(object);
+	audio_convert_destroy(object->convert);
+	object->convert = NULL;
 }
 
 void
 audio_object_close(struct audio_object *object)
 {
-	if (object)
-		object->close(object);
+	if (object) {
+		AUDIO_PROBE1(close_entry, object);
+		audio_async_flush(object);
+		if (!audio_standby_enter(object))
+			audio_close(object);
+		AUDIO_PROBE1(close_return, object);
+	}
+}
+
+int
+audio_object_set_standby(struct audio_object *object,
+                         uint32_t idle_ms)
+{
+	if (!object)
+		return 0;
+#if !defined(HAVE_PTHREAD_H)
+	if (idle_ms)
+		return -ENOSYS;
+#endif
+
+	object->standby.idle_ms = idle_ms;
+	if (idle_ms == 0)
+		audio_standby_close(object);
+	return 0;
 }
 
 void
 audio_object_destroy(struct audio_object *object)
 {
-	if (object)
+	if (object) {
+		audio_standby_close(object);
+		audio_async_destroy(object);
+		audio_convert_destroy(object->convert);
+		free(object->channel_map.matrix);
+		free(object->staging);
 		object->destroy(object);
+	}
 }
 
 int
@@ -51,24 +200,534 @@ audio_object_write(struct audio_object *object,
                    const void *data,
                    size_t bytes)
 {
-	if (object)
-		return object->write(object, data, bytes);
+	if (object) {
+		audio_async_wait(object);
+		return audio_write(object, data, bytes);
+	}
+	return 0;
+}
+
+static int
+audio_write_converted(struct audio_object *object,
+                      const char *data,
+                      size_t frames)
+{
+	size_t block = audio_convert_block(object->convert);
+	while (frames > 0) {
+		size_t count = frames < block ? frames : block;
+		size_t bytes = 0;
+		const void *converted = audio_convert_process(object->convert, data, count, &bytes);
+
+		int error = bytes ? object->write(object, converted, bytes) : 0;
+		if (error != 0)
+			return error;
+
+		audio_counter_add(&object->written_frames, count);
+		data += count * object->frame_size;
+		frames -= count;
+	}
 	return 0;
 }
 
+static uint64_t
+audio_time_us(void)
+{
+#ifdef HAVE_CLOCK_GETTIME
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+#else
+	return 0;
+#endif
+}
+
+/* The stats histogram bucket for a latency of `us` microseconds. */
+static int
+audio_latency_bucket(uint64_t us)
+{
+	int bucket = 0;
+	while (bucket < AUDIO_OBJECT_LATENCY_BUCKETS - 1 && (us >> bucket) != 0)
+		++bucket;
+	return bucket;
+}
+
+/* Count a write to the device that started at `start` (from audio_time_us),
+ * returning the time it took. */
+static uint64_t
+audio_stats_write(struct audio_object *object,
+                  uint64_t start,
+                  size_t frames,
+                  int error)
+{
+	struct audio_stats *stats = &object->stats;
+	uint64_t elapsed = audio_time_us() - start;
+
+	audio_counter_add(&stats->writes, 1);
+	audio_counter_add(&stats->write_latency[audio_latency_bucket(elapsed)], 1);
+	audio_counter_max(&stats->max_blocked_us, elapsed);
+	if (error != 0) {
+		audio_counter_add(&stats->errors, 1);
+		return elapsed;
+	}
+	audio_counter_add(&stats->frames_written, frames);
+	audio_counter_add(&stats->bytes_written, frames * object->frame_size);
+	return elapsed;
+}
+
+int
+audio_write(struct audio_object *object,
+            const void *data,
+            size_t bytes)
+{
+	AUDIO_PROBE2(write_entry, object, bytes);
+	uint64_t start = audio_time_us();
+	size_t frames = object->frame_size ? bytes / object->frame_size : 0;
+	int error = audio_write_begin(object);
+
+	if (error == 0) {
+		if (object->convert)
+			error = audio_write_converted(object, data, frames);
+		else {
+			error = object->write(object, data, bytes);
+			if (error == 0)
+				audio_counter_add(&object->written_frames, frames);
+		}
+		audio_write_end(object);
+	}
+
+	uint64_t elapsed = audio_stats_write(object, start, frames, error);
+	AUDIO_PROBE4(write_return, object, bytes, error, elapsed);
+	return error;
+}
+
 int
 audio_object_drain(struct audio_object *object)
 {
-	if (object)
-		return object->drain(object);
+	return audio_object_drain_timeout(object, -1);
+}
+
+int
+audio_object_drain_timeout(struct audio_object *object,
+                           int timeout_ms)
+{
+	if (!object)
+		return 0;
+
+	AUDIO_PROBE2(drain_entry, object, timeout_ms);
+	uint64_t generation = audio_counter_get(&object->drain_generation);
+	uint64_t deadline = audio_drain_deadline(timeout_ms);
+	int error = audio_async_wait_until(object, deadline);
+	if (error == 0)
+		error = audio_drain(object, deadline, generation);
+	AUDIO_PROBE2(drain_return, object, error);
+	return error;
+}
+
+int
+audio_object_drain_async(struct audio_object *object,
+                         audio_object_write_callback callback,
+                         void *userdata)
+{
+	if (!object)
+		return 0;
+
+	if (!object->async) {
+		int error = audio_async_create(object, DEFAULT_ASYNC_QUEUE_LENGTH, AUDIO_OBJECT_ASYNC_BLOCK);
+		if (error != 0)
+			return error;
+	}
+	return audio_async_drain(object, callback, userdata);
+}
+
+/* The backend delay in frames at the rate passed to audio_object_open. */
+static int
+audio_device_delay(struct audio_object *object,
+                   size_t *frames)
+{
+	if (!object->delay)
+		return -ENOSYS;
+
+	int error = object->delay(object, frames);
+	if (error != 0)
+		return error;
+
+	if (object->convert) {
+		if (object->device_rate != object->rate && object->device_rate)
+			*frames = (uint64_t)*frames * object->rate / object->device_rate;
+		*frames += audio_convert_delay(object->convert);
+	}
 	return 0;
 }
 
 int
 audio_object_flush(struct audio_object *object)
 {
-	if (object)
-		return object->flush(object);
+	if (object) {
+		AUDIO_PROBE1(flush_entry, object);
+		uint64_t start = audio_time_us();
+		if (!audio_flush_begin(object)) {
+			// Another thread flushed the object while this one waited.
+			AUDIO_PROBE3(flush_return, object, 0, audio_time_us() - start);
+			return 0;
+		}
+		audio_drain_cancel(object);
+		audio_async_flush(object);
+
+		// The discarded audio was never played, so remove it from the
+		// playback position.
+		size_t delay = 0;
+		if (audio_device_delay(object, &delay) == 0) {
+			uint64_t written = audio_counter_get(&object->written_frames);
+			audio_counter_set(&object->written_frames, delay < written ? written - delay : 0);
+		}
+		if (object->convert)
+			audio_convert_reset(object->convert);
+		int error = object->flush(object);
+		audio_flush_end(object);
+
+		uint64_t elapsed = audio_time_us() - start;
+		audio_counter_add(&object->stats.flushes, 1);
+		audio_counter_add(&object->stats.flush_latency[audio_latency_bucket(elapsed)], 1);
+		audio_counter_max(&object->stats.max_flush_us, elapsed);
+		AUDIO_PROBE3(flush_return, object, error, elapsed);
+		return error;
+	}
+	return 0;
+}
+
+int
+audio_object_set_async(struct audio_object *object,
+                       size_t queue_length,
+                       enum audio_object_async_policy policy)
+{
+	if (!object || queue_length == 0)
+		return -EINVAL;
+	return audio_async_create(object, queue_length, policy);
+}
+
+int
+audio_object_write_async(struct audio_object *object,
+                         const void *data,
+                         size_t bytes,
+                         int flags,
+                         audio_object_write_callback callback,
+                         void *userdata)
+{
+	if (!object)
+		return 0;
+
+	if (!object->async) {
+		int error = audio_async_create(object, DEFAULT_ASYNC_QUEUE_LENGTH, AUDIO_OBJECT_ASYNC_BLOCK);
+		if (error != 0)
+			return error;
+	}
+	return audio_async_write(object, data, bytes, flags, callback, userdata);
+}
+
+int
+audio_object_set_buffering(struct audio_object *object,
+                           uint32_t period_us,
+                           uint32_t periods,
+                           uint32_t latency_us)
+{
+	if (!object)
+		return 0;
+
+	object->buffering.period_us = period_us;
+	object->buffering.periods = periods;
+	object->buffering.latency_us = latency_us;
+	object->standby.stale = 1;
+	return 0;
+}
+
+int
+audio_object_get_buffering(struct audio_object *object,
+                           uint32_t *period_us,
+                           uint32_t *periods,
+                           uint32_t *latency_us)
+{
+	if (!object)
+		return 0;
+
+	if (period_us)
+		*period_us = object->negotiated.period_us;
+	if (periods)
+		*periods = object->negotiated.periods;
+	if (latency_us)
+		*latency_us = object->negotiated.latency_us;
+	return 0;
+}
+
+int
+audio_object_set_thresholds(struct audio_object *object,
+                            uint32_t start_us,
+                            uint32_t avail_min_us,
+                            uint32_t silence_us)
+{
+	if (!object)
+		return 0;
+
+	object->thresholds.start_us = start_us;
+	object->thresholds.avail_min_us = avail_min_us;
+	object->thresholds.silence_us = silence_us;
+	object->standby.stale = 1;
+	return 0;
+}
+
+int
+audio_object_set_resample_quality(struct audio_object *object,
+                                  enum audio_object_resample_quality quality)
+{
+	if (!object)
+		return 0;
+
+	if (quality > AUDIO_OBJECT_RESAMPLE_BEST)
+		return -EINVAL;
+	object->resample_quality = quality;
+	object->standby.stale = 1;
+	return 0;
+}
+
+int
+audio_object_set_xrun_policy(struct audio_object *object,
+                             enum audio_object_xrun_policy policy)
+{
+	if (!object)
+		return 0;
+
+	if (policy > AUDIO_OBJECT_XRUN_FAIL)
+		return -EINVAL;
+	object->xrun_policy = policy;
+	return 0;
+}
+
+int
+audio_object_set_xrun_callback(struct audio_object *object,
+                               audio_object_xrun_callback callback,
+                               void *userdata)
+{
+	if (!object)
+		return 0;
+
+	object->xrun_callback = callback;
+	object->xrun_userdata = userdata;
+	return 0;
+}
+
+void
+audio_xrun(struct audio_object *object,
+           enum audio_object_xrun_type type,
+           int status,
+           uint32_t recovery_us)
+{
+	if (object->xrun_callback)
+		object->xrun_callback(object, type, status, recovery_us, object->xrun_userdata);
+}
+
+int
+audio_object_get_device_format(struct audio_object *object,
+                               enum audio_object_format *format,
+                               uint32_t *rate,
+                               uint8_t *channels)
+{
+	if (!object)
+		return -EINVAL;
+
+	if (format)
+		*format = object->device_format;
+	if (rate)
+		*rate = object->device_rate;
+	if (channels)
+		*channels = object->device_channels;
+	return 0;
+}
+
+int
+audio_object_set_channel_map(struct audio_object *object,
+                             uint8_t in_channels,
+                             uint8_t out_channels,
+                             const float *matrix)
+{
+	if (!object)
+		return 0;
+
+	float *copy = NULL;
+	if (out_channels && !in_channels)
+		return -EINVAL;
+	if (out_channels && matrix) {
+		size_t size = (size_t)in_channels * out_channels * sizeof(float);
+		if (!(copy = malloc(size)))
+			return -ENOMEM;
+		memcpy(copy, matrix, size);
+	}
+
+	free(object->channel_map.matrix);
+	object->channel_map.in_channels = in_channels;
+	object->channel_map.out_channels = out_channels;
+	object->channel_map.matrix = copy;
+	object->standby.stale = 1;
+	return 0;
+}
+
+int
+audio_object_set_gain(struct audio_object *object,
+                      float gain)
+{
+	if (!object)
+		return 0;
+
+	if (!(gain >= 0.0f && gain <= 1.0f))
+		return -EINVAL;
+	if (!object->set_gain)
+		return -ENOSYS;
+	return object->set_gain(object, gain);
+}
+
+int
+audio_object_get_delay(struct audio_object *object,
+                       size_t *frames)
+{
+	if (!object || !frames)
+		return -EINVAL;
+
+	int error = audio_device_delay(object, frames);
+	if (error == 0 && object->frame_size)
+		*frames += audio_async_pending(object) / object->frame_size;
+	return error;
+}
+
+int
+audio_object_get_position(struct audio_object *object,
+                          uint64_t *frames)
+{
+	if (!object || !frames)
+		return -EINVAL;
+
+	size_t delay = 0;
+	uint64_t written = audio_counter_get(&object->written_frames);
+	int error = audio_device_delay(object, &delay);
+	if (error == 0)
+		*frames = delay < written ? written - delay : 0;
+	return error;
+}
+
+int
+audio_object_get_pollfds(struct audio_object *object,
+                         struct audio_object_pollfd *fds,
+                         unsigned int space)
+{
+	if (!object)
+		return -EINVAL;
+	if (!object->get_pollfds)
+		return -ENOSYS;
+	return object->get_pollfds(object, fds, fds ? space : 0);
+}
+
+int
+audio_object_service(struct audio_object *object,
+                     const struct audio_object_pollfd *fds,
+                     unsigned int nfds,
+                     size_t *frames)
+{
+	if (!object || !frames)
+		return -EINVAL;
+
+	*frames = 0;
+	if (!object->service)
+		return -ENOSYS;
+
+	size_t space = 0;
+	int error = object->service(object, fds, nfds, &space);
+	if (error != 0)
+		return error;
+
+	// The resampler can output a frame more than the input frames scaled
+	// to the device rate.
+	if (object->convert && object->device_rate != object->rate && object->device_rate)
+		space = space ? (uint64_t)(space - 1) * object->rate / object->device_rate : 0;
+	*frames = space;
+	return 0;
+}
+
+int
+audio_object_begin_write(struct audio_object *object,
+                         void **data,
+                         size_t *frames)
+{
+	if (!object || !data || !frames)
+		return -EINVAL;
+
+	audio_async_wait(object);
+	if (object->begin_write && !object->convert) {
+		int error = object->begin_write(object, data, frames);
+		if (error != -ENOSYS)
+			return error;
+	}
+
+	size_t count = *frames ? *frames : DEFAULT_STAGING_FRAMES(object->rate);
+	if (count == 0 || object->frame_size == 0)
+		return -EINVAL;
+
+	if (count > object->staging_frames) {
+		void *staging = realloc(object->staging, count * object->frame_size);
+		if (!staging)
+			return -ENOMEM;
+		object->staging = staging;
+		object->staging_frames = count;
+	}
+
+	object->staging_pending = 1;
+	*data = object->staging;
+	*frames = count;
+	return 0;
+}
+
+int
+audio_object_commit(struct audio_object *object,
+                    size_t frames)
+{
+	if (!object)
+		return 0;
+
+	if (object->staging_pending) {
+		object->staging_pending = 0;
+		return frames ? audio_write(object, object->staging, frames * object->frame_size) : 0;
+	}
+	if (!object->commit)
+		return -EINVAL;
+
+	AUDIO_PROBE2(commit_entry, object, frames);
+	uint64_t start = audio_time_us();
+	int error = object->commit(object, frames);
+	if (error == 0)
+		audio_counter_add(&object->written_frames, frames);
+	uint64_t elapsed = audio_stats_write(object, start, frames, error);
+	AUDIO_PROBE4(commit_return, object, frames, error, elapsed);
+	return error;
+}
+
+int
+audio_object_get_stats(struct audio_object *object,
+                       struct audio_object_stats *stats)
+{
+	if (!object || !stats)
+		return -EINVAL;
+
+	stats->bytes_written = audio_counter_get(&object->stats.bytes_written);
+	stats->frames_written = audio_counter_get(&object->stats.frames_written);
+	stats->writes = audio_counter_get(&object->stats.writes);
+	stats->errors = audio_counter_get(&object->stats.errors);
+	stats->underruns = audio_counter_get(&object->stats.underruns);
+	stats->suspends = audio_counter_get(&object->stats.suspends);
+	stats->prepares = audio_counter_get(&object->stats.prepares);
+	stats->short_writes = audio_counter_get(&object->stats.short_writes);
+	stats->max_blocked_us = audio_counter_get(&object->stats.max_blocked_us);
+	stats->flushes = audio_counter_get(&object->stats.flushes);
+	stats->max_flush_us = audio_counter_get(&object->stats.max_flush_us);
+	for (int i = 0; i < AUDIO_OBJECT_LATENCY_BUCKETS; ++i) {
+		stats->write_latency[i] = audio_counter_get(&object->stats.write_latency[i]);
+		stats->flush_latency[i] = audio_counter_get(&object->stats.flush_latency[i]);
+	}
 	return 0;
 }
 
@@ -81,30 +740,95 @@ audio_object_strerror(struct audio_object *object,
 	return NULL;
 }
 
-struct audio_object *
-create_audio_device_object(const char *device,
-                           const char *application_name,
-                           const char *description)
+struct audio_backend
 {
-	struct audio_object *object;
-#if defined(_WIN32) || defined(_WIN64)
-	if ((object = create_xaudio2_object(device, application_name, description)) != NULL)
-		return object;
-#else
-#if defined(__APPLE__)
-	if ((object = create_coreaudio_object(device, application_name, description)) != NULL)
-		return object;
+	const char *name;
+	struct audio_object * (*create)(const char *device,
+	                                const char *application_name,
+	                                const char *description);
+	int autodetect; // tried when no backend is named
+};
 
+/* Backends in the order they are tried by create_audio_device_object. */
+static const struct audio_backend backends[] =
+{
+#if defined(_WIN32) || defined(_WIN64)
+	{ "xaudio2",           create_xaudio2_object,           1 },
+#elif defined(__APPLE__)
+	{ "coreaudio",         create_coreaudio_object,         1 },
 #else
-	if ((object = create_pulseaudio_object(device, application_name, description)) != NULL)
-		return object;
-	if ((object = create_alsa_object(device, application_name, description)) != NULL)
-		return object;
-	if ((object = create_qsa_object(device, application_name, description)) != NULL)
-		return object;
-	if ((object = create_oss_object(device, application_name, description)) != NULL)
-		return object;
-#endif
+	{ "pipewire",          create_pipewire_object,          1 },
+	{ "pulseaudio",        create_pulseaudio_object,        1 },
+	{ "pulseaudio-simple", create_pulseaudio_simple_object, 0 },
+	{ "alsa",              create_alsa_object,              1 },
+	{ "qsa",               create_qsa_object,               1 },
+	{ "oss",               create_oss_object,               1 },
 #endif
+	{ "null",              create_null_object,              0 },
+	{ NULL, NULL, 0 },
+};
+
+static struct audio_object *
+create_backend_object(const struct audio_backend *backend,
+                      const char *device,
+                      const char *application_name,
+                      const char *description)
+{
+	struct audio_object *object = backend->create(device, application_name, description);
+	if (object)
+		object->backend = backend->name;
+	return object;
+}
+
+const char *
+audio_object_get_backend(struct audio_object *object)
+{
+	return object ? object->backend : NULL;
+}
+
+struct audio_object *
+create_audio_device_object_ex(const char *backend,
+                              const char *device,
+                              const char *application_name,
+                              const char *description)
+{
+	const struct audio_backend *current;
+	struct audio_object *object;
+
+	if (!backend)
+		backend = getenv("PCAUDIO_BACKEND");
+
+	if (!backend || !*backend) {
+		for (current = backends; current->name; ++current) {
+			if (!current->autodetect)
+				continue;
+			if ((object = create_backend_object(current, device, application_name, description)) != NULL)
+				return object;
+		}
+		return NULL;
+	}
+
+	// A comma separated list of backends to try in order.
+	while (*backend) {
+		size_t length = strcspn(backend, ",");
+		for (current = backends; current->name; ++current) {
+			if (strlen(current->name) == length && !strncmp(current->name, backend, length)) {
+				if ((object = create_backend_object(current, device, application_name, description)) != NULL)
+					return object;
+				break;
+			}
+		}
+		backend += length;
+		if (*backend == ',')
+			++backend;
+	}
 	return NULL;
 }
+
+struct audio_object *
+create_audio_device_object(const char *device,
+                           const char *application_name,
+                           const char *description)
+{
+	return create_audio_device_object_ex(NULL, device, application_name, description);
+}
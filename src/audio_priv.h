@@ -24,11 +24,96 @@
 #include <pcaudiolib/audio.h>
 #include <stddef.h>
 
+#include <stdint.h>
+
+/* The counters are plain 64-bit integers in both C and C++, so the structures
+ * containing them have the same layout in the C++ backends. They are updated
+ * with the compiler's atomic builtins where these are available.
+ */
+typedef uint64_t audio_counter;
+
+#if defined(__GNUC__)
+#define AUDIO_COUNTER_ATOMIC 1
+
+#define audio_counter_add(counter, value) __atomic_fetch_add(counter, value, __ATOMIC_RELAXED)
+#define audio_counter_sub(counter, value) __atomic_fetch_sub(counter, value, __ATOMIC_RELAXED)
+#define audio_counter_get(counter) __atomic_load_n(counter, __ATOMIC_RELAXED)
+#define audio_counter_set(counter, value) __atomic_store_n(counter, value, __ATOMIC_RELAXED)
+
+static inline void
+audio_counter_max(audio_counter *counter, uint64_t value)
+{
+	uint64_t current = __atomic_load_n(counter, __ATOMIC_RELAXED);
+	while (current < value &&
+	       !__atomic_compare_exchange_n(counter, &current, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+#else
+#define audio_counter_add(counter, value) (*(counter) += (value))
+#define audio_counter_sub(counter, value) (*(counter) -= (value))
+#define audio_counter_get(counter) (*(counter))
+#define audio_counter_set(counter, value) (*(counter) = (value))
+#define audio_counter_max(counter, value) do { if (*(counter) < (value)) *(counter) = (value); } while (0)
+#endif
+
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
+struct audio_buffering
+{
+	uint32_t period_us;
+	uint32_t periods;
+	uint32_t latency_us;
+};
+
+struct audio_thresholds
+{
+	uint32_t start_us;
+	uint32_t avail_min_us;
+	uint32_t silence_us;
+};
+
+/* Warm standby state (standby.c). All but idle_ms and stale are protected by
+ * the standby mutex. */
+struct audio_standby
+{
+	uint32_t idle_ms;
+	int active;          // closed by the caller, but the device is still open
+	int stale;           // the open parameters changed while in standby
+	int closing;         // the reaper is closing the device
+	int forked;          // the device belongs to the parent of this process
+	uint64_t deadline;   // when the reaper closes the device
+	struct audio_object *next;
+};
+
+/* Counters behind audio_object_get_stats. The backends update underruns,
+ * suspends, prepares and short_writes; audio.c updates the rest. */
+struct audio_stats
+{
+	audio_counter bytes_written;
+	audio_counter frames_written;
+	audio_counter writes;
+	audio_counter errors;
+	audio_counter underruns;
+	audio_counter suspends;
+	audio_counter prepares;
+	audio_counter short_writes;
+	audio_counter max_blocked_us;
+	audio_counter write_latency[AUDIO_OBJECT_LATENCY_BUCKETS];
+	audio_counter flushes;
+	audio_counter max_flush_us;
+	audio_counter flush_latency[AUDIO_OBJECT_LATENCY_BUCKETS];
+};
+
+struct audio_channel_map
+{
+	uint8_t in_channels;
+	uint8_t out_channels;
+	float *matrix;
+};
+
 struct audio_object
 {
 	int (*open)(struct audio_object *object,
@@ -50,10 +135,375 @@ struct audio_object
 
 	const char * (*strerror)(struct audio_object *object,
 	                         int error);
+
+	/* optional -- return -ENOSYS to use a staging buffer */
+	int (*begin_write)(struct audio_object *object,
+	                   void **data,
+	                   size_t *frames);
+
+	int (*commit)(struct audio_object *object,
+	              size_t frames);
+
+	/* optional -- the number of frames queued in the device */
+	int (*delay)(struct audio_object *object,
+	             size_t *frames);
+
+	/* optional */
+	int (*set_gain)(struct audio_object *object,
+	                float gain);
+
+	/* optional -- wait until `deadline` (see audio_drain_deadline) for the
+	 * audio to be played, returning -ETIMEDOUT if it has not been, or
+	 * -ECANCELED as soon as drain_generation differs from `generation` */
+	int (*drain_until)(struct audio_object *object,
+	                   uint64_t deadline,
+	                   uint64_t generation);
+
+	/* optional -- interrupt drain_until when the object is flushed */
+	void (*wake)(struct audio_object *object);
+
+	/* optional -- `frames` is the space in the device buffer */
+	int (*get_pollfds)(struct audio_object *object,
+	                   struct audio_object_pollfd *fds,
+	                   unsigned int space);
+
+	int (*service)(struct audio_object *object,
+	               const struct audio_object_pollfd *fds,
+	               unsigned int nfds,
+	               size_t *frames);
+
+	/* optional -- drop the device handle without closing it, as it belongs
+	 * to the parent of a forked process; close is used by default */
+	void (*forget)(struct audio_object *object);
+
+	/* optional -- stop the device without closing it (enable is 1), or
+	 * restart it (enable is 0); flush is used to stop it by default */
+	int (*set_standby)(struct audio_object *object,
+	                   int enable);
+
+	/* state managed by audio.c -- zero initialized by the backends */
+	const char *backend;
+	enum audio_object_format format;
+	uint32_t rate;
+	uint8_t channels;
+	enum audio_object_format device_format;
+	uint32_t device_rate;
+	uint8_t device_channels;
+	struct audio_channel_map channel_map;
+	enum audio_object_resample_quality resample_quality;
+	enum audio_object_xrun_policy xrun_policy;
+	audio_object_xrun_callback xrun_callback;
+	void *xrun_userdata;
+	struct audio_convert *convert;
+	size_t frame_size;
+	audio_counter written_frames;
+	audio_counter drain_generation;
+	audio_counter drainers;
+	audio_counter write_generation; // odd while a flush is running
+	audio_counter writers;
+	struct audio_stats stats;
+	struct audio_async *async;
+	void *staging;
+	size_t staging_frames;
+	int staging_pending;
+
+	/* buffering requested by the caller, and what the backend negotiated */
+	struct audio_buffering buffering;
+	struct audio_buffering negotiated;
+
+	/* start and wakeup thresholds requested by the caller */
+	struct audio_thresholds thresholds;
+
+	struct audio_standby standby;
 };
 
+size_t
+audio_object_format_size(enum audio_object_format format);
+
+/* Write to the backend, keeping track of the playback position. */
+int
+audio_write(struct audio_object *object,
+            const void *data,
+            size_t bytes);
+
+/* Close the device and release the converter. */
+void
+audio_close(struct audio_object *object);
+
+/* Report a recovery from an underrun or suspend to the xrun callback. */
+void
+audio_xrun(struct audio_object *object,
+           enum audio_object_xrun_type type,
+           int status,
+           uint32_t recovery_us);
+
+/* Sample format conversion (convert.c) */
+
+/* Backends that do not support a format open the device with the closest
+ * format they support returned by this, setting device_format to it. */
+enum audio_object_format
+audio_convert_nearest(enum audio_object_format format,
+                      const enum audio_object_format *supported,
+                      size_t count);
+
+int
+audio_convert_supported(enum audio_object_format format);
+
+const char *
+audio_convert_kernels(void);
+
+/* Fill `matrix` with the gains used to mix in_channels to out_channels when
+ * the caller does not provide a matrix -- out_channels rows of in_channels. */
+void
+audio_convert_default_matrix(uint8_t in_channels,
+                             uint8_t out_channels,
+                             float *matrix);
+
+struct audio_convert *
+audio_convert_create(enum audio_object_format from,
+                     uint32_t from_rate,
+                     uint8_t from_channels,
+                     enum audio_object_format to,
+                     uint32_t to_rate,
+                     uint8_t to_channels,
+                     const float *matrix,
+                     enum audio_object_resample_quality quality);
+
+void
+audio_convert_destroy(struct audio_convert *convert);
+
+size_t
+audio_convert_block(struct audio_convert *convert);
+
+const void *
+audio_convert_process(struct audio_convert *convert,
+                      const void *in,
+                      size_t frames,
+                      size_t *bytes);
+
+/* Convert the audio held by the resampler, and reset it. */
+const void *
+audio_convert_drain(struct audio_convert *convert,
+                    size_t *bytes);
+
+void
+audio_convert_reset(struct audio_convert *convert);
+
+/* The number of input frames held by the resampler. */
+size_t
+audio_convert_delay(struct audio_convert *convert);
+
+/* Sample rate conversion (resample.c) */
+
+const char *
+audio_resample_kernels(void);
+
+struct audio_resample *
+audio_resample_create(uint32_t from_rate,
+                      uint32_t to_rate,
+                      uint8_t channels,
+                      enum audio_object_resample_quality quality);
+
+void
+audio_resample_destroy(struct audio_resample *r);
+
+void
+audio_resample_reset(struct audio_resample *r);
+
+size_t
+audio_resample_delay(struct audio_resample *r);
+
+/* The maximum number of frames output for `frames` input frames. */
+size_t
+audio_resample_max_output(struct audio_resample *r,
+                          size_t frames);
+
+/* Resample interleaved frames, returning the number of frames output. */
+size_t
+audio_resample_process(struct audio_resample *r,
+                       const float *in,
+                       size_t frames,
+                       float *out);
+
+/* Output the frames held in the filter, and reset it. */
+size_t
+audio_resample_drain(struct audio_resample *r,
+                     float *out);
+
+/* Asynchronous write queue (async.c) */
+
+int
+audio_async_create(struct audio_object *object,
+                   size_t queue_length,
+                   enum audio_object_async_policy policy);
+
+void
+audio_async_destroy(struct audio_object *object);
+
+int
+audio_async_write(struct audio_object *object,
+                  const void *data,
+                  size_t bytes,
+                  int flags,
+                  audio_object_write_callback callback,
+                  void *userdata);
+
+void
+audio_async_wait(struct audio_object *object);
+
+void
+audio_async_flush(struct audio_object *object);
+
+/* Wait for the queue to be written, returning -ETIMEDOUT if it has not been
+ * by `deadline`. */
+int
+audio_async_wait_until(struct audio_object *object,
+                       uint64_t deadline);
+
+/* Queue a drain of the audio written before it, calling `callback` with the
+ * result of audio_drain. */
+int
+audio_async_drain(struct audio_object *object,
+                  audio_object_write_callback callback,
+                  void *userdata);
+
+size_t
+audio_async_pending(struct audio_object *object);
+
+/* Interruptible drain (drain.c) */
+
+/* The CLOCK_MONOTONIC time in milliseconds `timeout_ms` from now, or
+ * UINT64_MAX if timeout_ms is negative. */
+uint64_t
+audio_drain_deadline(int timeout_ms);
+
+/* The milliseconds left before `deadline`, or -1 if there is no deadline. */
+int
+audio_drain_remaining(uint64_t deadline);
+
+struct timespec;
+
+/* Convert `deadline` to the absolute time used by pthread_cond_timedwait. */
+void
+audio_drain_abstime(uint64_t deadline,
+                    struct timespec *ts);
+
+/* Sleep for `ms`, returning -ECANCELED early if the object is flushed. */
+int
+audio_drain_sleep(struct audio_object *object,
+                  uint64_t generation,
+                  uint32_t ms);
+
+/* Cancel the drains in progress and wake the threads waiting in them. */
+void
+audio_drain_cancel(struct audio_object *object);
+
+/* Write the audio held by the converter, and wait for the device to play it.
+ * `generation` is the drain_generation when the drain was requested. */
+int
+audio_drain(struct audio_object *object,
+            uint64_t deadline,
+            uint64_t generation);
+
+/* Write cancellation (cancel.c) */
+
+/* Count a write to the backend as in progress, returning -ECANCELED instead
+ * if the object is being flushed. A successful call is matched by a call to
+ * audio_write_end. */
+int
+audio_write_begin(struct audio_object *object);
+
+void
+audio_write_end(struct audio_object *object);
+
+/* Whether a flush is waiting for the write in progress. Backends check this
+ * when they wake from waiting for space in the device, returning -ECANCELED,
+ * and are woken by their wake function when the flush starts. */
+int
+audio_write_cancelled(struct audio_object *object);
+
+/* Cancel the writes in progress and wait for them to leave the backend,
+ * returning 1. If another thread is flushing the object, wait for it to
+ * finish instead and return 0. */
+int
+audio_flush_begin(struct audio_object *object);
+
+/* Let writes to the object start again. */
+void
+audio_flush_end(struct audio_object *object);
+
+/* Warm standby (standby.c) */
+
+/* Stop the device and keep it open for standby.idle_ms, returning 1, or
+ * return 0 if the device should be closed. */
+int
+audio_standby_enter(struct audio_object *object);
+
+/* Restart a device in standby if it was opened with the same parameters,
+ * returning 1, or close it and return 0. */
+int
+audio_standby_resume(struct audio_object *object,
+                     enum audio_object_format format,
+                     uint32_t rate,
+                     uint8_t channels);
+
+/* Close the device if it is in standby. */
+void
+audio_standby_close(struct audio_object *object);
+
+/* Device handle pool (pool.c) */
+
+/* The parameters a pooled handle was opened with. The strings are owned by
+ * the caller, and are NULL if the backend does not use them. */
+struct audio_pool_key
+{
+	const char *backend;
+	const char *device;
+	const char *application_name;
+	const char *description;
+	enum audio_object_format format;
+	uint32_t rate;
+	uint8_t channels;
+	enum audio_object_resample_quality resample_quality;
+	struct audio_buffering buffering;
+	struct audio_thresholds thresholds;
+};
+
+/* Set `key` from the open parameters and the buffering, thresholds and
+ * resample quality the object is being opened with. */
+void
+audio_pool_key_init(struct audio_pool_key *key,
+                    struct audio_object *object,
+                    const char *backend,
+                    const char *device,
+                    const char *application_name,
+                    const char *description,
+                    enum audio_object_format format,
+                    uint32_t rate,
+                    uint8_t channels);
+
+/* Whether closed handles are kept in the pool. */
+int
+audio_pool_enabled(void);
+
+/* Take a handle opened with `key` out of the pool, or return NULL. */
+void *
+audio_pool_get(const struct audio_pool_key *key);
+
+/* Return a handle to the pool. The handle, or handles evicted to make room
+ * for it, are closed with `release` if the pool is full or disabled. */
+void
+audio_pool_put(const struct audio_pool_key *key,
+               void *handle,
+               void (*release)(void *handle));
+
+struct audio_object *
+create_null_object(const char *device,
+                   const char *application_name,
+                   const char *description);
+
 /* 60ms is the minimum and default buffer size used by eSpeak */
-#define LATENCY 60
+#define DEFAULT_LATENCY_US 60000
 
 #if defined(_WIN32) || defined(_WIN64)
 
@@ -94,11 +544,21 @@ create_coreaudio_object(const char *device,
 
 #else
 
+struct audio_object *
+create_pipewire_object(const char *device,
+                       const char *application_name,
+                       const char *description);
+
 struct audio_object *
 create_pulseaudio_object(const char *device,
                          const char *application_name,
                          const char *description);
 
+struct audio_object *
+create_pulseaudio_simple_object(const char *device,
+                                const char *application_name,
+                                const char *description);
+
 struct audio_object *
 create_alsa_object(const char *device,
                    const char *application_name,
@@ -0,0 +1,146 @@
+/* Write Cancellation.
+ *
+ * Copyright (C) 2026 Reece H. Dunn
+ *
+ * This file is part of pcaudiolib.
+ *
+ * pcaudiolib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pcaudiolib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pcaudiolib.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "audio_priv.h"
+
+#include <errno.h>
+
+#if defined(HAVE_PTHREAD_H) && defined(AUDIO_COUNTER_ATOMIC)
+
+#include <pthread.h>
+
+/* A flush makes the object's write_generation odd while it runs, and even
+ * again when it is done. Writers count themselves in `writers` and then read
+ * the generation, and the flush makes the generation odd and then reads the
+ * count, so with sequentially consistent atomics either the writer sees the
+ * flush and gives up, or the flush sees the writer and waits for it to leave
+ * the backend. The backends check audio_write_cancelled when they wake from
+ * waiting for space, so the writes in progress return promptly.
+ *
+ * The write path does not take a lock. The mutex and condition are only used
+ * by a writer when it leaves the backend while a flush is waiting for it, and
+ * by threads flushing the same object at the same time.
+ */
+static pthread_mutex_t cancel_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cancel_cond = PTHREAD_COND_INITIALIZER;
+
+int
+audio_write_begin(struct audio_object *object)
+{
+	// Writes that start during a flush give up without counting themselves,
+	// so a writer that retries straight away does not hold up the flush.
+	if ((__atomic_load_n(&object->write_generation, __ATOMIC_SEQ_CST) & 1) != 0)
+		return -ECANCELED;
+
+	__atomic_fetch_add(&object->writers, 1, __ATOMIC_SEQ_CST);
+	if ((__atomic_load_n(&object->write_generation, __ATOMIC_SEQ_CST) & 1) == 0)
+		return 0;
+
+	audio_write_end(object);
+	return -ECANCELED;
+}
+
+void
+audio_write_end(struct audio_object *object)
+{
+	if (__atomic_fetch_sub(&object->writers, 1, __ATOMIC_SEQ_CST) == 1 &&
+	    (__atomic_load_n(&object->write_generation, __ATOMIC_SEQ_CST) & 1) != 0) {
+		pthread_mutex_lock(&cancel_mutex);
+		pthread_cond_broadcast(&cancel_cond);
+		pthread_mutex_unlock(&cancel_mutex);
+	}
+}
+
+int
+audio_write_cancelled(struct audio_object *object)
+{
+	return (__atomic_load_n(&object->write_generation, __ATOMIC_SEQ_CST) & 1) != 0;
+}
+
+int
+audio_flush_begin(struct audio_object *object)
+{
+	uint64_t generation = __atomic_load_n(&object->write_generation, __ATOMIC_SEQ_CST);
+	while ((generation & 1) == 0) {
+		if (__atomic_compare_exchange_n(&object->write_generation, &generation, generation + 1, 1,
+		                                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+			break;
+	}
+	if ((generation & 1) != 0) {
+		// Another thread is flushing the object, which also discards the
+		// audio written before this flush, so wait for it to finish.
+		pthread_mutex_lock(&cancel_mutex);
+		while (__atomic_load_n(&object->write_generation, __ATOMIC_SEQ_CST) == generation)
+			pthread_cond_wait(&cancel_cond, &cancel_mutex);
+		pthread_mutex_unlock(&cancel_mutex);
+		return 0;
+	}
+
+	if (object->wake)
+		object->wake(object);
+
+	pthread_mutex_lock(&cancel_mutex);
+	while (__atomic_load_n(&object->writers, __ATOMIC_SEQ_CST) != 0)
+		pthread_cond_wait(&cancel_cond, &cancel_mutex);
+	pthread_mutex_unlock(&cancel_mutex);
+	return 1;
+}
+
+void
+audio_flush_end(struct audio_object *object)
+{
+	pthread_mutex_lock(&cancel_mutex);
+	__atomic_fetch_add(&object->write_generation, 1, __ATOMIC_SEQ_CST);
+	pthread_cond_broadcast(&cancel_cond);
+	pthread_mutex_unlock(&cancel_mutex);
+}
+
+#else
+
+int
+audio_write_begin(struct audio_object *object)
+{
+	return 0;
+}
+
+void
+audio_write_end(struct audio_object *object)
+{
+}
+
+int
+audio_write_cancelled(struct audio_object *object)
+{
+	return 0;
+}
+
+int
+audio_flush_begin(struct audio_object *object)
+{
+	return 1;
+}
+
+void
+audio_flush_end(struct audio_object *object)
+{
+}
+
+#endif
@@ -0,0 +1,1261 @@
+/* Sample Format Conversion.
+ *
+ * Copyright (C) 2026 Reece H. Dunn
+ *
+ * This file is part of pcaudiolib.
+ *
+ * pcaudiolib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pcaudiolib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pcaudiolib.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "audio_priv.h"
+
+#include <math.h>
+#include <string.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) && defined(__aarch64__) && defined(__ARM_NEON)
+#define HAVE_NEON_KERNELS
+#include <arm_neon.h>
+#endif
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define NATIVE_S16  AUDIO_OBJECT_FORMAT_S16BE
+#define NATIVE_S24  AUDIO_OBJECT_FORMAT_S24BE
+#define NATIVE_S32  AUDIO_OBJECT_FORMAT_S32BE
+#define NATIVE_F32  AUDIO_OBJECT_FORMAT_FLOAT32BE
+#else
+#define NATIVE_S16  AUDIO_OBJECT_FORMAT_S16LE
+#define NATIVE_S24  AUDIO_OBJECT_FORMAT_S24LE
+#define NATIVE_S32  AUDIO_OBJECT_FORMAT_S32LE
+#define NATIVE_F32  AUDIO_OBJECT_FORMAT_FLOAT32LE
+#endif
+
+/* The number of frames converted at a time. */
+#define CONVERT_BLOCK 1024
+
+/* ------------------------------------------------------------------------- */
+/* Format descriptions                                                       */
+
+#define FORMAT_SIGNED 1
+#define FORMAT_FLOAT  2
+#define FORMAT_BE     4
+
+struct format_info
+{
+	uint8_t size;  // bytes per sample, or 0 if the format cannot be converted
+	uint8_t bits;  // significant bits, stored in the low bits of the sample
+	uint8_t flags;
+};
+
+static const struct format_info formats[] =
+{
+	{ 1,  8, FORMAT_SIGNED },              // S8
+	{ 1,  8, 0 },                          // U8
+	{ 2, 16, FORMAT_SIGNED },              // S16LE
+	{ 2, 16, FORMAT_SIGNED | FORMAT_BE },  // S16BE
+	{ 2, 16, 0 },                          // U16LE
+	{ 2, 16, FORMAT_BE },                  // U16BE
+	{ 3, 18, FORMAT_SIGNED },              // S18LE
+	{ 3, 18, FORMAT_SIGNED | FORMAT_BE },  // S18BE
+	{ 3, 18, 0 },                          // U18LE
+	{ 3, 18, FORMAT_BE },                  // U18BE
+	{ 3, 20, FORMAT_SIGNED },              // S20LE
+	{ 3, 20, FORMAT_SIGNED | FORMAT_BE },  // S20BE
+	{ 3, 20, 0 },                          // U20LE
+	{ 3, 20, FORMAT_BE },                  // U20BE
+	{ 3, 24, FORMAT_SIGNED },              // S24LE
+	{ 3, 24, FORMAT_SIGNED | FORMAT_BE },  // S24BE
+	{ 3, 24, 0 },                          // U24LE
+	{ 3, 24, FORMAT_BE },                  // U24BE
+	{ 4, 24, FORMAT_SIGNED },              // S24_32LE
+	{ 4, 24, FORMAT_SIGNED | FORMAT_BE },  // S24_32BE
+	{ 4, 24, 0 },                          // U24_32LE
+	{ 4, 24, FORMAT_BE },                  // U24_32BE
+	{ 4, 32, FORMAT_SIGNED },              // S32LE
+	{ 4, 32, FORMAT_SIGNED | FORMAT_BE },  // S32BE
+	{ 4, 32, 0 },                          // U32LE
+	{ 4, 32, FORMAT_BE },                  // U32BE
+	{ 4, 24, FORMAT_FLOAT },               // FLOAT32LE
+	{ 4, 24, FORMAT_FLOAT | FORMAT_BE },   // FLOAT32BE
+	{ 8, 53, FORMAT_FLOAT },               // FLOAT64LE
+	{ 8, 53, FORMAT_FLOAT | FORMAT_BE },   // FLOAT64BE
+};
+
+static const struct format_info *
+format_info(enum audio_object_format format)
+{
+	if ((size_t)format >= sizeof(formats) / sizeof(formats[0]))
+		return NULL;
+	return &formats[format];
+}
+
+static int
+format_is_native(const struct format_info *info)
+{
+	return (info->flags & FORMAT_BE) == (formats[NATIVE_S16].flags & FORMAT_BE);
+}
+
+/* ------------------------------------------------------------------------- */
+/* Scalar kernels                                                            */
+
+static uint32_t
+xorshift32(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+// Triangular (TPDF) dither of +/- 1 LSB.
+static float
+tpdf_dither(uint32_t *state)
+{
+	float a = (float)(xorshift32(state) >> 8) * (1.0f / 16777216.0f);
+	float b = (float)(xorshift32(state) >> 8) * (1.0f / 16777216.0f);
+	return a - b;
+}
+
+static void
+scalar_s16_to_f32(const int16_t *in, float *out, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		out[i] = in[i] * (1.0f / 32768.0f);
+}
+
+static void
+scalar_f32_to_s16(const float *in, int16_t *out, size_t n, uint32_t *seeds, int dither)
+{
+	for (size_t i = 0; i < n; ++i) {
+		float x = in[i] * 32768.0f;
+		if (dither)
+			x += tpdf_dither(&seeds[0]);
+		x = x < -32768.0f ? -32768.0f : (x > 32767.0f ? 32767.0f : x);
+		// Round half to even, as the SIMD conversions do.
+		out[i] = (int16_t)lrintf(x);
+	}
+}
+
+static void
+scalar_swap16(const void *in, void *out, size_t n)
+{
+	const uint16_t *src = in;
+	uint16_t *dst = out;
+	for (size_t i = 0; i < n; ++i)
+		dst[i] = (uint16_t)((src[i] << 8) | (src[i] >> 8));
+}
+
+static void
+scalar_swap32(const void *in, void *out, size_t n)
+{
+	const uint32_t *src = in;
+	uint32_t *dst = out;
+	for (size_t i = 0; i < n; ++i) {
+		uint32_t x = src[i];
+		dst[i] = (x << 24) | ((x << 8) & 0x00FF0000) | ((x >> 8) & 0x0000FF00) | (x >> 24);
+	}
+}
+
+// Native endian 3-byte samples to/from the top 24 bits of 32-bit samples.
+static void
+scalar_s24_to_s32(const uint8_t *in, int32_t *out, size_t n)
+{
+	for (size_t i = 0; i < n; ++i, in += 3) {
+		uint32_t x;
+		if (format_is_native(&formats[AUDIO_OBJECT_FORMAT_S24LE]))
+			x = ((uint32_t)in[0] << 8) | ((uint32_t)in[1] << 16) | ((uint32_t)in[2] << 24);
+		else
+			x = ((uint32_t)in[2] << 8) | ((uint32_t)in[1] << 16) | ((uint32_t)in[0] << 24);
+		out[i] = (int32_t)x;
+	}
+}
+
+static void
+scalar_s32_to_s24(const int32_t *in, uint8_t *out, size_t n)
+{
+	for (size_t i = 0; i < n; ++i, out += 3) {
+		uint32_t x = (uint32_t)in[i];
+		if (format_is_native(&formats[AUDIO_OBJECT_FORMAT_S24LE])) {
+			out[0] = x >> 8;
+			out[1] = x >> 16;
+			out[2] = x >> 24;
+		} else {
+			out[2] = x >> 8;
+			out[1] = x >> 16;
+			out[0] = x >> 24;
+		}
+	}
+}
+
+static void
+scalar_duplicate16(const int16_t *in, int16_t *out, size_t frames)
+{
+	for (size_t i = 0; i < frames; ++i) {
+		out[2 * i] = in[i];
+		out[2 * i + 1] = in[i];
+	}
+}
+
+static void
+scalar_upmix_f32(const float *in, float *out, size_t frames, const float *gains, uint8_t channels)
+{
+	for (size_t i = 0; i < frames; ++i)
+		for (uint8_t c = 0; c < channels; ++c)
+			*out++ = in[i] * gains[c];
+}
+
+static void
+scalar_downmix_f32(const float *in, float *out, size_t frames, const float *gains)
+{
+	for (size_t i = 0; i < frames; ++i)
+		out[i] = in[2 * i] * gains[0] + in[2 * i + 1] * gains[1];
+}
+
+/* ------------------------------------------------------------------------- */
+/* x86 kernels                                                               */
+
+#ifdef HAVE_X86_KERNELS
+
+__attribute__((target("sse2")))
+static void
+sse2_s16_to_f32(const int16_t *in, float *out, size_t n)
+{
+	const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+		_mm_storeu_ps(out + i,     _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+		_mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+	}
+	scalar_s16_to_f32(in + i, out + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static inline __m128
+sse2_uniform(__m128i *state)
+{
+	__m128i x = *state;
+	x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+	x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+	x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+	*state = x;
+	return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(x, 8)), _mm_set1_ps(1.0f / 16777216.0f));
+}
+
+__attribute__((target("sse2")))
+static void
+sse2_f32_to_s16(const float *in, int16_t *out, size_t n, uint32_t *seeds, int dither)
+{
+	const __m128 scale = _mm_set1_ps(32768.0f);
+	const __m128 lo = _mm_set1_ps(-32768.0f);
+	const __m128 hi = _mm_set1_ps(32767.0f);
+	__m128i state = _mm_loadu_si128((const __m128i *)seeds);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128 a = _mm_mul_ps(_mm_loadu_ps(in + i), scale);
+		__m128 b = _mm_mul_ps(_mm_loadu_ps(in + i + 4), scale);
+		if (dither) {
+			a = _mm_add_ps(a, _mm_sub_ps(sse2_uniform(&state), sse2_uniform(&state)));
+			b = _mm_add_ps(b, _mm_sub_ps(sse2_uniform(&state), sse2_uniform(&state)));
+		}
+		a = _mm_min_ps(_mm_max_ps(a, lo), hi);
+		b = _mm_min_ps(_mm_max_ps(b, lo), hi);
+		_mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+	}
+	_mm_storeu_si128((__m128i *)seeds, state);
+	scalar_f32_to_s16(in + i, out + i, n - i, seeds, dither);
+}
+
+__attribute__((target("sse2")))
+static void
+sse2_swap16(const void *in, void *out, size_t n)
+{
+	const uint16_t *src = in;
+	uint16_t *dst = out;
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8)));
+	}
+	scalar_swap16(src + i, dst + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void
+sse2_swap32(const void *in, void *out, size_t n)
+{
+	const uint32_t *src = in;
+	uint32_t *dst = out;
+	const __m128i mask = _mm_set1_epi32(0x00FF00FF);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+		// Swap the bytes in each 16-bit half, then swap the halves.
+		x = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(x, 8), mask), _mm_slli_epi32(_mm_and_si128(x, mask), 8));
+		x = _mm_or_si128(_mm_srli_epi32(x, 16), _mm_slli_epi32(x, 16));
+		_mm_storeu_si128((__m128i *)(dst + i), x);
+	}
+	scalar_swap32(src + i, dst + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void
+sse2_duplicate16(const int16_t *in, int16_t *out, size_t frames)
+{
+	size_t i = 0;
+	for (; i + 8 <= frames; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+		_mm_storeu_si128((__m128i *)(out + 2 * i),     _mm_unpacklo_epi16(x, x));
+		_mm_storeu_si128((__m128i *)(out + 2 * i + 8), _mm_unpackhi_epi16(x, x));
+	}
+	scalar_duplicate16(in + i, out + 2 * i, frames - i);
+}
+
+__attribute__((target("sse2")))
+static void
+sse2_upmix_f32(const float *in, float *out, size_t frames, const float *gains, uint8_t channels)
+{
+	if (channels != 2) {
+		scalar_upmix_f32(in, out, frames, gains, channels);
+		return;
+	}
+
+	const __m128 g = _mm_setr_ps(gains[0], gains[1], gains[0], gains[1]);
+	size_t i = 0;
+	for (; i + 4 <= frames; i += 4) {
+		__m128 x = _mm_loadu_ps(in + i);
+		_mm_storeu_ps(out + 2 * i,     _mm_mul_ps(_mm_unpacklo_ps(x, x), g));
+		_mm_storeu_ps(out + 2 * i + 4, _mm_mul_ps(_mm_unpackhi_ps(x, x), g));
+	}
+	scalar_upmix_f32(in + i, out + 2 * i, frames - i, gains, channels);
+}
+
+__attribute__((target("sse2")))
+static void
+sse2_downmix_f32(const float *in, float *out, size_t frames, const float *gains)
+{
+	const __m128 g0 = _mm_set1_ps(gains[0]);
+	const __m128 g1 = _mm_set1_ps(gains[1]);
+	size_t i = 0;
+	for (; i + 4 <= frames; i += 4) {
+		__m128 a = _mm_loadu_ps(in + 2 * i);
+		__m128 b = _mm_loadu_ps(in + 2 * i + 4);
+		__m128 left  = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 right = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+		_mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(left, g0), _mm_mul_ps(right, g1)));
+	}
+	scalar_downmix_f32(in + 2 * i, out + i, frames - i, gains);
+}
+
+__attribute__((target("ssse3")))
+static void
+ssse3_s24_to_s32(const uint8_t *in, int32_t *out, size_t n)
+{
+	const __m128i shuffle = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+	size_t i = 0;
+	// Each load reads 16 bytes to use 12, so stop while 4 bytes remain.
+	for (; i + 6 <= n; i += 4) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(in + i * 3));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_shuffle_epi8(x, shuffle));
+	}
+	scalar_s24_to_s32(in + i * 3, out + i, n - i);
+}
+
+__attribute__((target("ssse3")))
+static void
+ssse3_s32_to_s24(const int32_t *in, uint8_t *out, size_t n)
+{
+	const __m128i shuffle = _mm_setr_epi8(1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, -1, -1, -1, -1);
+	size_t i = 0;
+	// Each store writes 16 bytes to output 12, so stop while 4 bytes remain.
+	for (; i + 6 <= n; i += 4) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+		_mm_storeu_si128((__m128i *)(out + i * 3), _mm_shuffle_epi8(x, shuffle));
+	}
+	scalar_s32_to_s24(in + i, out + i * 3, n - i);
+}
+
+__attribute__((target("avx2")))
+static void
+avx2_s16_to_f32(const int16_t *in, float *out, size_t n)
+{
+	const __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(in + i)));
+		__m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(in + i + 8)));
+		_mm256_storeu_ps(out + i,     _mm256_mul_ps(_mm256_cvtepi32_ps(lo), scale));
+		_mm256_storeu_ps(out + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(hi), scale));
+	}
+	scalar_s16_to_f32(in + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256
+avx2_uniform(__m256i *state)
+{
+	__m256i x = *state;
+	x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 13));
+	x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 17));
+	x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 5));
+	*state = x;
+	return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(x, 8)), _mm256_set1_ps(1.0f / 16777216.0f));
+}
+
+__attribute__((target("avx2")))
+static void
+avx2_f32_to_s16(const float *in, int16_t *out, size_t n, uint32_t *seeds, int dither)
+{
+	const __m256 scale = _mm256_set1_ps(32768.0f);
+	const __m256 lo = _mm256_set1_ps(-32768.0f);
+	const __m256 hi = _mm256_set1_ps(32767.0f);
+	__m256i state = _mm256_loadu_si256((const __m256i *)seeds);
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m256 a = _mm256_mul_ps(_mm256_loadu_ps(in + i), scale);
+		__m256 b = _mm256_mul_ps(_mm256_loadu_ps(in + i + 8), scale);
+		if (dither) {
+			a = _mm256_add_ps(a, _mm256_sub_ps(avx2_uniform(&state), avx2_uniform(&state)));
+			b = _mm256_add_ps(b, _mm256_sub_ps(avx2_uniform(&state), avx2_uniform(&state)));
+		}
+		a = _mm256_min_ps(_mm256_max_ps(a, lo), hi);
+		b = _mm256_min_ps(_mm256_max_ps(b, lo), hi);
+		// packs works within 128-bit lanes, so restore the sample order.
+		__m256i x = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+		_mm256_storeu_si256((__m256i *)(out + i), _mm256_permute4x64_epi64(x, 0xD8));
+	}
+	_mm256_storeu_si256((__m256i *)seeds, state);
+	scalar_f32_to_s16(in + i, out + i, n - i, seeds, dither);
+}
+
+__attribute__((target("avx2")))
+static void
+avx2_swap16(const void *in, void *out, size_t n)
+{
+	const uint16_t *src = in;
+	uint16_t *dst = out;
+	const __m256i shuffle = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+	                                         1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)(src + i));
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_shuffle_epi8(x, shuffle));
+	}
+	scalar_swap16(src + i, dst + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void
+avx2_swap32(const void *in, void *out, size_t n)
+{
+	const uint32_t *src = in;
+	uint32_t *dst = out;
+	const __m256i shuffle = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+	                                         3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)(src + i));
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_shuffle_epi8(x, shuffle));
+	}
+	scalar_swap32(src + i, dst + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void
+avx2_duplicate16(const int16_t *in, int16_t *out, size_t frames)
+{
+	size_t i = 0;
+	for (; i + 16 <= frames; i += 16) {
+		__m256i x = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i *)(in + i)), _MM_SHUFFLE(3, 1, 2, 0));
+		_mm256_storeu_si256((__m256i *)(out + 2 * i),      _mm256_unpacklo_epi16(x, x));
+		_mm256_storeu_si256((__m256i *)(out + 2 * i + 16), _mm256_unpackhi_epi16(x, x));
+	}
+	scalar_duplicate16(in + i, out + 2 * i, frames - i);
+}
+
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* NEON kernels                                                              */
+
+#ifdef HAVE_NEON_KERNELS
+
+static void
+neon_s16_to_f32(const int16_t *in, float *out, size_t n)
+{
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		int16x8_t x = vld1q_s16(in + i);
+		vst1q_f32(out + i,     vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(x))), 1.0f / 32768.0f));
+		vst1q_f32(out + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(x))), 1.0f / 32768.0f));
+	}
+	scalar_s16_to_f32(in + i, out + i, n - i);
+}
+
+static inline float32x4_t
+neon_uniform(uint32x4_t *state)
+{
+	uint32x4_t x = *state;
+	x = veorq_u32(x, vshlq_n_u32(x, 13));
+	x = veorq_u32(x, vshrq_n_u32(x, 17));
+	x = veorq_u32(x, vshlq_n_u32(x, 5));
+	*state = x;
+	return vmulq_n_f32(vcvtq_f32_u32(vshrq_n_u32(x, 8)), 1.0f / 16777216.0f);
+}
+
+static void
+neon_f32_to_s16(const float *in, int16_t *out, size_t n, uint32_t *seeds, int dither)
+{
+	uint32x4_t state = vld1q_u32(seeds);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		float32x4_t a = vmulq_n_f32(vld1q_f32(in + i), 32768.0f);
+		float32x4_t b = vmulq_n_f32(vld1q_f32(in + i + 4), 32768.0f);
+		if (dither) {
+			a = vaddq_f32(a, vsubq_f32(neon_uniform(&state), neon_uniform(&state)));
+			b = vaddq_f32(b, vsubq_f32(neon_uniform(&state), neon_uniform(&state)));
+		}
+		// vqmovn saturates to the 16-bit range.
+		int16x4_t lo = vqmovn_s32(vcvtnq_s32_f32(a));
+		int16x4_t hi = vqmovn_s32(vcvtnq_s32_f32(b));
+		vst1q_s16(out + i, vcombine_s16(lo, hi));
+	}
+	vst1q_u32(seeds, state);
+	scalar_f32_to_s16(in + i, out + i, n - i, seeds, dither);
+}
+
+static void
+neon_swap16(const void *in, void *out, size_t n)
+{
+	const uint16_t *src = in;
+	uint16_t *dst = out;
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+		vst1q_u8((uint8_t *)(dst + i), vrev16q_u8(vld1q_u8((const uint8_t *)(src + i))));
+	scalar_swap16(src + i, dst + i, n - i);
+}
+
+static void
+neon_swap32(const void *in, void *out, size_t n)
+{
+	const uint32_t *src = in;
+	uint32_t *dst = out;
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+		vst1q_u8((uint8_t *)(dst + i), vrev32q_u8(vld1q_u8((const uint8_t *)(src + i))));
+	scalar_swap32(src + i, dst + i, n - i);
+}
+
+static void
+neon_duplicate16(const int16_t *in, int16_t *out, size_t frames)
+{
+	size_t i = 0;
+	for (; i + 8 <= frames; i += 8) {
+		int16x8_t x = vld1q_s16(in + i);
+		int16x8x2_t y = { { x, x } };
+		vst2q_s16(out + 2 * i, y);
+	}
+	scalar_duplicate16(in + i, out + 2 * i, frames - i);
+}
+
+static void
+neon_upmix_f32(const float *in, float *out, size_t frames, const float *gains, uint8_t channels)
+{
+	if (channels != 2) {
+		scalar_upmix_f32(in, out, frames, gains, channels);
+		return;
+	}
+
+	size_t i = 0;
+	for (; i + 4 <= frames; i += 4) {
+		float32x4_t x = vld1q_f32(in + i);
+		float32x4x2_t y = { { vmulq_n_f32(x, gains[0]), vmulq_n_f32(x, gains[1]) } };
+		vst2q_f32(out + 2 * i, y);
+	}
+	scalar_upmix_f32(in + i, out + 2 * i, frames - i, gains, channels);
+}
+
+static void
+neon_downmix_f32(const float *in, float *out, size_t frames, const float *gains)
+{
+	size_t i = 0;
+	for (; i + 4 <= frames; i += 4) {
+		float32x4x2_t x = vld2q_f32(in + 2 * i);
+		vst1q_f32(out + i, vmlaq_n_f32(vmulq_n_f32(x.val[0], gains[0]), x.val[1], gains[1]));
+	}
+	scalar_downmix_f32(in + 2 * i, out + i, frames - i, gains);
+}
+
+static void
+neon_s24_to_s32(const uint8_t *in, int32_t *out, size_t n)
+{
+	static const uint8_t table[16] = { 255, 0, 1, 2, 255, 3, 4, 5, 255, 6, 7, 8, 255, 9, 10, 11 };
+	const uint8x16_t shuffle = vld1q_u8(table);
+	size_t i = 0;
+	for (; i + 6 <= n; i += 4) {
+		uint8x16_t x = vqtbl1q_u8(vld1q_u8(in + i * 3), shuffle);
+		vst1q_s32(out + i, vreinterpretq_s32_u8(x));
+	}
+	scalar_s24_to_s32(in + i * 3, out + i, n - i);
+}
+
+static void
+neon_s32_to_s24(const int32_t *in, uint8_t *out, size_t n)
+{
+	static const uint8_t table[16] = { 1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, 255, 255, 255, 255 };
+	const uint8x16_t shuffle = vld1q_u8(table);
+	size_t i = 0;
+	for (; i + 6 <= n; i += 4) {
+		uint8x16_t x = vqtbl1q_u8(vreinterpretq_u8_s32(vld1q_s32(in + i)), shuffle);
+		vst1q_u8(out + i * 3, x);
+	}
+	scalar_s32_to_s24(in + i, out + i * 3, n - i);
+}
+
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* Runtime dispatch                                                          */
+
+struct convert_kernels
+{
+	const char *name;
+	void (*s16_to_f32)(const int16_t *in, float *out, size_t n);
+	void (*f32_to_s16)(const float *in, int16_t *out, size_t n, uint32_t *seeds, int dither);
+	void (*swap16)(const void *in, void *out, size_t n);
+	void (*swap32)(const void *in, void *out, size_t n);
+	void (*s24_to_s32)(const uint8_t *in, int32_t *out, size_t n);
+	void (*s32_to_s24)(const int32_t *in, uint8_t *out, size_t n);
+	void (*duplicate16)(const int16_t *in, int16_t *out, size_t frames);
+	void (*upmix_f32)(const float *in, float *out, size_t frames, const float *gains, uint8_t channels);
+	void (*downmix_f32)(const float *in, float *out, size_t frames, const float *gains);
+};
+
+static struct convert_kernels kernels =
+{
+	"scalar",
+	scalar_s16_to_f32,
+	scalar_f32_to_s16,
+	scalar_swap16,
+	scalar_swap32,
+	scalar_s24_to_s32,
+	scalar_s32_to_s24,
+	scalar_duplicate16,
+	scalar_upmix_f32,
+	scalar_downmix_f32,
+};
+
+static void
+select_kernels(void)
+{
+#if defined(HAVE_X86_KERNELS)
+	// The 24-bit kernels assume a little endian host, which x86 is.
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2")) {
+		kernels.name = "sse2";
+		kernels.s16_to_f32 = sse2_s16_to_f32;
+		kernels.f32_to_s16 = sse2_f32_to_s16;
+		kernels.swap16 = sse2_swap16;
+		kernels.swap32 = sse2_swap32;
+		kernels.duplicate16 = sse2_duplicate16;
+		kernels.upmix_f32 = sse2_upmix_f32;
+		kernels.downmix_f32 = sse2_downmix_f32;
+	}
+	if (__builtin_cpu_supports("ssse3")) {
+		kernels.s24_to_s32 = ssse3_s24_to_s32;
+		kernels.s32_to_s24 = ssse3_s32_to_s24;
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		kernels.name = "avx2";
+		kernels.s16_to_f32 = avx2_s16_to_f32;
+		kernels.f32_to_s16 = avx2_f32_to_s16;
+		kernels.swap16 = avx2_swap16;
+		kernels.swap32 = avx2_swap32;
+		kernels.duplicate16 = avx2_duplicate16;
+	}
+#elif defined(HAVE_NEON_KERNELS) && !defined(__AARCH64EB__)
+	// NEON is part of the AArch64 base architecture.
+	kernels.name = "neon";
+	kernels.s16_to_f32 = neon_s16_to_f32;
+	kernels.f32_to_s16 = neon_f32_to_s16;
+	kernels.swap16 = neon_swap16;
+	kernels.swap32 = neon_swap32;
+	kernels.s24_to_s32 = neon_s24_to_s32;
+	kernels.s32_to_s24 = neon_s32_to_s24;
+	kernels.duplicate16 = neon_duplicate16;
+	kernels.upmix_f32 = neon_upmix_f32;
+	kernels.downmix_f32 = neon_downmix_f32;
+#endif
+}
+
+static void
+init_kernels(void)
+{
+#ifdef HAVE_PTHREAD_H
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	pthread_once(&once, select_kernels);
+#else
+	static int initialized = 0;
+	if (!initialized) {
+		select_kernels();
+		initialized = 1;
+	}
+#endif
+}
+
+const char *
+audio_convert_kernels(void)
+{
+	init_kernels();
+	return kernels.name;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Generic conversion through 32-bit float                                   */
+
+static uint64_t
+read_sample(const uint8_t *in, const struct format_info *info)
+{
+	uint64_t x = 0;
+	if (info->flags & FORMAT_BE) {
+		for (int i = 0; i < info->size; ++i)
+			x = (x << 8) | in[i];
+	} else {
+		for (int i = info->size - 1; i >= 0; --i)
+			x = (x << 8) | in[i];
+	}
+	return x;
+}
+
+static void
+write_sample(uint8_t *out, uint64_t x, const struct format_info *info)
+{
+	if (info->flags & FORMAT_BE) {
+		for (int i = info->size - 1; i >= 0; --i, x >>= 8)
+			out[i] = (uint8_t)x;
+	} else {
+		for (int i = 0; i < info->size; ++i, x >>= 8)
+			out[i] = (uint8_t)x;
+	}
+}
+
+static void
+decode_f32(const void *in, enum audio_object_format format, float *out, size_t n)
+{
+	const struct format_info *info = format_info(format);
+	const uint8_t *src = in;
+
+	if (format == NATIVE_S16) {
+		kernels.s16_to_f32(in, out, n);
+		return;
+	}
+	if (format == NATIVE_F32) {
+		memcpy(out, in, n * sizeof(float));
+		return;
+	}
+
+	const float scale = 1.0f / (float)((uint64_t)1 << (info->bits - 1));
+	for (size_t i = 0; i < n; ++i, src += info->size) {
+		uint64_t x = read_sample(src, info);
+		if (info->flags & FORMAT_FLOAT) {
+			if (info->size == 4) {
+				uint32_t bits = (uint32_t)x;
+				float f;
+				memcpy(&f, &bits, sizeof(f));
+				out[i] = f;
+			} else {
+				double d;
+				memcpy(&d, &x, sizeof(d));
+				out[i] = (float)d;
+			}
+			continue;
+		}
+
+		int64_t value;
+		x &= ((uint64_t)1 << info->bits) - 1;
+		if (info->flags & FORMAT_SIGNED)
+			value = (int64_t)(x << (64 - info->bits)) >> (64 - info->bits);
+		else
+			value = (int64_t)x - ((int64_t)1 << (info->bits - 1));
+		out[i] = (float)value * scale;
+	}
+}
+
+static void
+encode_f32(const float *in, enum audio_object_format format, void *out, size_t n, uint32_t *seeds, int dither)
+{
+	const struct format_info *info = format_info(format);
+	uint8_t *dst = out;
+
+	if (format == NATIVE_S16) {
+		kernels.f32_to_s16(in, out, n, seeds, dither);
+		return;
+	}
+	if (format == NATIVE_F32) {
+		memcpy(out, in, n * sizeof(float));
+		return;
+	}
+
+	const double scale = (double)((uint64_t)1 << (info->bits - 1));
+	const double max = scale - 1.0;
+	for (size_t i = 0; i < n; ++i, dst += info->size) {
+		uint64_t x;
+		if (info->flags & FORMAT_FLOAT) {
+			if (info->size == 4) {
+				uint32_t bits;
+				memcpy(&bits, &in[i], sizeof(bits));
+				x = bits;
+			} else {
+				double d = in[i];
+				memcpy(&x, &d, sizeof(x));
+			}
+		} else {
+			double value = (double)in[i] * scale;
+			if (dither)
+				value += tpdf_dither(&seeds[0]);
+			value = value < -scale ? -scale : (value > max ? max : value);
+			int64_t sample = (int64_t)(value < 0 ? value - 0.5 : value + 0.5);
+			if (!(info->flags & FORMAT_SIGNED))
+				sample += (int64_t)1 << (info->bits - 1);
+			x = (uint64_t)sample & (((uint64_t)1 << info->bits) - 1);
+		}
+		write_sample(dst, x, info);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* Conversion objects                                                        */
+
+enum convert_route
+{
+	ROUTE_GENERIC,   // decode to float and encode
+	ROUTE_SWAP16,    // byte swap 16-bit samples
+	ROUTE_SWAP32,    // byte swap 32-bit samples
+	ROUTE_S24_S32,   // unpack native 24-bit samples to 32-bit samples
+	ROUTE_S32_S24,   // pack native 32-bit samples to 24-bit samples
+	ROUTE_DUPLICATE, // copy mono samples to each channel
+};
+
+enum convert_mix
+{
+	MIX_NONE,
+	MIX_UPMIX,       // mono to N channels
+	MIX_DOWNMIX,     // stereo to mono
+	MIX_MATRIX,
+};
+
+struct audio_convert
+{
+	enum audio_object_format from;
+	enum audio_object_format to;
+	uint8_t channels;
+	uint8_t out_channels;
+	enum convert_route route;
+	enum convert_mix mix;
+	float *matrix;
+	int dither;
+	uint32_t seeds[8];
+	float *scratch;
+	float *mixed;
+	struct audio_resample *resample;
+	float *resampled;
+	uint8_t *out;
+};
+
+int
+audio_convert_supported(enum audio_object_format format)
+{
+	const struct format_info *info = format_info(format);
+	return info && info->size != 0;
+}
+
+static int
+nearest_score(const struct format_info *from, const struct format_info *to)
+{
+	int score = 0;
+	if ((from->flags & FORMAT_FLOAT) != (to->flags & FORMAT_FLOAT))
+		score += 8;
+	if (to->bits < from->bits)
+		score += 64 + (from->bits - to->bits) * 4; // Avoid losing precision.
+	else
+		score += to->bits - from->bits;
+	if (!format_is_native(to))
+		score += 2;
+	if (!(to->flags & (FORMAT_SIGNED | FORMAT_FLOAT)))
+		score += 1;
+	return score;
+}
+
+enum audio_object_format
+audio_convert_nearest(enum audio_object_format format,
+                      const enum audio_object_format *supported,
+                      size_t count)
+{
+	if (!audio_convert_supported(format))
+		return format;
+
+	enum audio_object_format best = format;
+	int best_score = -1;
+	for (size_t i = 0; i < count; ++i) {
+		if (supported[i] == format)
+			return format;
+		if (!audio_convert_supported(supported[i]))
+			continue;
+
+		int score = nearest_score(format_info(format), format_info(supported[i]));
+		if (best_score == -1 || score < best_score) {
+			best = supported[i];
+			best_score = score;
+		}
+	}
+	return best;
+}
+
+static enum convert_route
+select_route(enum audio_object_format from, enum audio_object_format to)
+{
+	const struct format_info *a = format_info(from);
+	const struct format_info *b = format_info(to);
+
+	// Only the byte order differs.
+	if (a->size == b->size && a->bits == b->bits &&
+	    (a->flags & ~FORMAT_BE) == (b->flags & ~FORMAT_BE)) {
+		if (a->size == 2)
+			return ROUTE_SWAP16;
+		if (a->size == 4)
+			return ROUTE_SWAP32;
+	}
+
+	if (from == NATIVE_S24 && to == NATIVE_S32)
+		return ROUTE_S24_S32;
+	if (from == NATIVE_S32 && to == NATIVE_S24)
+		return ROUTE_S32_S24;
+	return ROUTE_GENERIC;
+}
+
+/* The channel order used by ALSA and WAVE files. */
+#define CHANNEL_FC  2
+#define CHANNEL_LFE 3
+
+static int
+channel_is_lfe(uint8_t channel, uint8_t channels)
+{
+	return channel == CHANNEL_LFE && channels >= 6;
+}
+
+void
+audio_convert_default_matrix(uint8_t in_channels,
+                             uint8_t out_channels,
+                             float *matrix)
+{
+	memset(matrix, 0, (size_t)in_channels * out_channels * sizeof(float));
+
+	if (in_channels == 1) {
+		// Copy mono to every channel but the subwoofer.
+		for (uint8_t o = 0; o < out_channels; ++o)
+			matrix[o] = channel_is_lfe(o, out_channels) ? 0.0f : 1.0f;
+		return;
+	}
+
+	if (out_channels == 1) {
+		uint8_t count = in_channels >= 6 ? in_channels - 1 : in_channels;
+		for (uint8_t i = 0; i < in_channels; ++i)
+			matrix[i] = channel_is_lfe(i, in_channels) ? 0.0f : 1.0f / count;
+		return;
+	}
+
+	if (out_channels == 2 && in_channels >= 6) {
+		// ITU-R BS.775 downmix of 5.1 and 7.1, scaled so it does not clip.
+		float scale = 1.0f / (1.0f + 0.7071f * (in_channels >= 8 ? 3 : 2));
+		for (uint8_t i = 0; i < in_channels; ++i) {
+			float gain = i < 2 ? 1.0f : 0.7071f;
+			if (channel_is_lfe(i, in_channels))
+				continue;
+			if (i == CHANNEL_FC) {
+				matrix[i] = gain * scale;
+				matrix[in_channels + i] = gain * scale;
+			} else // Even channels are on the left, odd on the right.
+				matrix[(i & 1) * in_channels + i] = gain * scale;
+		}
+		return;
+	}
+
+	// Keep the channels common to both layouts.
+	uint8_t common = in_channels < out_channels ? in_channels : out_channels;
+	for (uint8_t c = 0; c < common; ++c)
+		matrix[c * in_channels + c] = 1.0f;
+}
+
+static int
+matrix_is_duplicate(const float *matrix, uint8_t in_channels, uint8_t out_channels)
+{
+	if (in_channels != 1)
+		return 0;
+	for (uint8_t o = 0; o < out_channels; ++o)
+		if (matrix[o] != 1.0f)
+			return 0;
+	return 1;
+}
+
+static void
+mix_frames(struct audio_convert *convert, const float *in, float *out, size_t frames)
+{
+	uint8_t in_channels = convert->channels;
+	uint8_t out_channels = convert->out_channels;
+	const float *matrix = convert->matrix;
+
+	switch (convert->mix)
+	{
+	case MIX_UPMIX:
+		kernels.upmix_f32(in, out, frames, matrix, out_channels);
+		break;
+	case MIX_DOWNMIX:
+		kernels.downmix_f32(in, out, frames, matrix);
+		break;
+	default:
+		for (size_t i = 0; i < frames; ++i, in += in_channels)
+			for (uint8_t o = 0; o < out_channels; ++o) {
+				const float *gains = matrix + o * in_channels;
+				float x = 0;
+				for (uint8_t c = 0; c < in_channels; ++c)
+					x += in[c] * gains[c];
+				*out++ = x;
+			}
+		break;
+	}
+}
+
+static void
+duplicate_frames(struct audio_convert *convert, const void *in, size_t frames)
+{
+	size_t size = format_info(convert->from)->size;
+	if (size == 2 && convert->out_channels == 2) {
+		kernels.duplicate16(in, (int16_t *)convert->out, frames);
+		return;
+	}
+
+	const uint8_t *src = in;
+	uint8_t *dst = convert->out;
+	for (size_t i = 0; i < frames; ++i, src += size)
+		for (uint8_t o = 0; o < convert->out_channels; ++o, dst += size)
+			memcpy(dst, src, size);
+}
+
+struct audio_convert *
+audio_convert_create(enum audio_object_format from,
+                     uint32_t from_rate,
+                     uint8_t from_channels,
+                     enum audio_object_format to,
+                     uint32_t to_rate,
+                     uint8_t to_channels,
+                     const float *matrix,
+                     enum audio_object_resample_quality quality)
+{
+	if (!audio_convert_supported(from) || !audio_convert_supported(to) || from_channels == 0 || to_channels == 0)
+		return NULL;
+
+	init_kernels();
+
+	struct audio_convert *convert = calloc(1, sizeof(struct audio_convert));
+	if (!convert)
+		return NULL;
+
+	convert->from = from;
+	convert->to = to;
+	convert->channels = from_channels;
+	convert->out_channels = to_channels;
+	convert->route = select_route(from, to);
+
+	// Dither when reducing to 16 bits or less, where the truncation
+	// distortion is audible.
+	const struct format_info *a = format_info(from);
+	const struct format_info *b = format_info(to);
+	convert->dither = !(b->flags & FORMAT_FLOAT) && b->bits <= 16 && a->bits > b->bits;
+	for (int i = 0; i < 8; ++i)
+		convert->seeds[i] = 0x9E3779B9u * (i + 1);
+
+	uint8_t mixed_channels = from_channels;
+	if (from_channels != to_channels || matrix) {
+		size_t count = (size_t)from_channels * to_channels;
+		convert->matrix = malloc(count * sizeof(float));
+		if (!convert->matrix)
+			goto error;
+		if (matrix)
+			memcpy(convert->matrix, matrix, count * sizeof(float));
+		else
+			audio_convert_default_matrix(from_channels, to_channels, convert->matrix);
+
+		if (from == to && from_rate == to_rate && matrix_is_duplicate(convert->matrix, from_channels, to_channels))
+			convert->route = ROUTE_DUPLICATE;
+		else {
+			convert->route = ROUTE_GENERIC;
+			if (from_channels == 1)
+				convert->mix = MIX_UPMIX;
+			else if (from_channels == 2 && to_channels == 1)
+				convert->mix = MIX_DOWNMIX;
+			else
+				convert->mix = MIX_MATRIX;
+		}
+		mixed_channels = to_channels;
+	}
+
+	// Resample the smaller number of channels.
+	size_t out_frames = CONVERT_BLOCK;
+	if (from_rate != to_rate) {
+		uint8_t channels = from_channels < to_channels ? from_channels : to_channels;
+		convert->route = ROUTE_GENERIC;
+		convert->resample = audio_resample_create(from_rate, to_rate, channels, quality);
+		if (!convert->resample)
+			goto error;
+		out_frames = audio_resample_max_output(convert->resample, CONVERT_BLOCK);
+		convert->resampled = malloc(out_frames * channels * sizeof(float));
+		if (!convert->resampled)
+			goto error;
+	}
+
+	if (convert->mix != MIX_NONE) {
+		size_t frames = out_frames > CONVERT_BLOCK ? out_frames : CONVERT_BLOCK;
+		convert->mixed = malloc(frames * mixed_channels * sizeof(float));
+		if (!convert->mixed)
+			goto error;
+	}
+
+	convert->scratch = malloc(CONVERT_BLOCK * from_channels * sizeof(float));
+	convert->out = malloc(out_frames * to_channels * b->size);
+	if (!convert->scratch || !convert->out)
+		goto error;
+	return convert;
+error:
+	audio_convert_destroy(convert);
+	return NULL;
+}
+
+void
+audio_convert_destroy(struct audio_convert *convert)
+{
+	if (!convert)
+		return;
+
+	audio_resample_destroy(convert->resample);
+	free(convert->resampled);
+	free(convert->matrix);
+	free(convert->mixed);
+	free(convert->scratch);
+	free(convert->out);
+	free(convert);
+}
+
+size_t
+audio_convert_block(struct audio_convert *convert)
+{
+	return CONVERT_BLOCK;
+}
+
+/* Mix and resample the decoded frames in scratch, or the frames held by the
+ * resampler if draining, and encode them to the output buffer. */
+static size_t
+convert_float(struct audio_convert *convert, size_t frames, int drain)
+{
+	float *data = convert->scratch;
+	int mix_first = convert->out_channels < convert->channels;
+
+	if (convert->mix != MIX_NONE && mix_first && !drain) {
+		mix_frames(convert, data, convert->mixed, frames);
+		data = convert->mixed;
+	}
+	if (convert->resample) {
+		if (drain)
+			frames = audio_resample_drain(convert->resample, convert->resampled);
+		else
+			frames = audio_resample_process(convert->resample, data, frames, convert->resampled);
+		data = convert->resampled;
+	} else if (drain)
+		return 0;
+	if (convert->mix != MIX_NONE && !mix_first) {
+		mix_frames(convert, data, convert->mixed, frames);
+		data = convert->mixed;
+	}
+
+	encode_f32(data, convert->to, convert->out, frames * convert->out_channels, convert->seeds, convert->dither);
+	return frames;
+}
+
+const void *
+audio_convert_process(struct audio_convert *convert,
+                      const void *in,
+                      size_t frames,
+                      size_t *bytes)
+{
+	size_t n = frames * convert->channels;
+
+	switch (convert->route)
+	{
+	case ROUTE_SWAP16:
+		kernels.swap16(in, convert->out, n);
+		break;
+	case ROUTE_SWAP32:
+		kernels.swap32(in, convert->out, n);
+		break;
+	case ROUTE_S24_S32:
+		kernels.s24_to_s32(in, (int32_t *)convert->out, n);
+		break;
+	case ROUTE_S32_S24:
+		kernels.s32_to_s24(in, convert->out, n);
+		break;
+	case ROUTE_DUPLICATE:
+		duplicate_frames(convert, in, frames);
+		break;
+	default:
+		decode_f32(in, convert->from, convert->scratch, n);
+		frames = convert_float(convert, frames, 0);
+		break;
+	}
+
+	*bytes = frames * convert->out_channels * format_info(convert->to)->size;
+	return convert->out;
+}
+
+const void *
+audio_convert_drain(struct audio_convert *convert,
+                    size_t *bytes)
+{
+	size_t frames = convert_float(convert, 0, 1);
+	*bytes = frames * convert->out_channels * format_info(convert->to)->size;
+	return convert->out;
+}
+
+void
+audio_convert_reset(struct audio_convert *convert)
+{
+	if (convert->resample)
+		audio_resample_reset(convert->resample);
+}
+
+size_t
+audio_convert_delay(struct audio_convert *convert)
+{
+	return convert->resample ? audio_resample_delay(convert->resample) : 0;
+}
@@ -52,6 +52,11 @@ struct coreaudio_object
 
 #define to_coreaudio_object(object) container_of(object, struct coreaudio_object, vtable)
 
+static const enum audio_object_format coreaudio_formats[] =
+{
+	AUDIO_OBJECT_FORMAT_S16LE,
+};
+
 static OSStatus graphRenderProc(void *inRefCon,
 						 AudioUnitRenderActionFlags *ioActionFlags,
 						 const AudioTimeStamp *inTimeStamp,
@@ -92,6 +97,8 @@ coreaudio_object_open(struct audio_object *object,
 	(self->format).mSampleRate = rate;
 	(self->format).mChannelsPerFrame = channels;
 	(self->format).mFramesPerPacket = 1;
+	format = audio_convert_nearest(format, coreaudio_formats, sizeof(coreaudio_formats) / sizeof(coreaudio_formats[0]));
+	object->device_format = format;
 	switch (format)
 	{
 		case AUDIO_OBJECT_FORMAT_S16LE:
@@ -277,7 +284,7 @@ create_coreaudio_object(const char *device,
 	if (!coreaudio_is_available(device, application_name, description))
 		return NULL;
 
-	struct coreaudio_object *self = malloc(sizeof(struct coreaudio_object));
+	struct coreaudio_object *self = calloc(1, sizeof(struct coreaudio_object));
 	if (!self)
 		return NULL;
 
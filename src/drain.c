@@ -0,0 +1,276 @@
+/* Interruptible Drain.
+ *
+ * Copyright (C) 2026 Reece H. Dunn
+ *
+ * This file is part of pcaudiolib.
+ *
+ * pcaudiolib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pcaudiolib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pcaudiolib.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "audio_priv.h"
+
+#include <errno.h>
+#include <limits.h>
+
+/* A drain is cancelled by audio_object_flush incrementing the object's
+ * drain_generation. Drainers compare it with the value it had when the drain
+ * was requested, so a flush that happens before the drainer starts waiting is
+ * not missed. Backends that wait on their own descriptors implement
+ * drain_until and wake; the others are drained here by sleeping for the
+ * delay they report.
+ */
+
+static int
+audio_drain_cancelled(struct audio_object *object,
+                      uint64_t generation)
+{
+	return audio_counter_get(&object->drain_generation) != generation;
+}
+
+static int
+audio_drain_write_tail(struct audio_object *object)
+{
+	if (!object->convert)
+		return 0;
+
+	size_t bytes = 0;
+	const void *data = audio_convert_drain(object->convert, &bytes);
+	return bytes ? object->write(object, data, bytes) : 0;
+}
+
+#if defined(HAVE_PTHREAD_H)
+
+#include <pthread.h>
+#include <time.h>
+
+/* Sleepers in audio_drain_sleep are woken by any flush; each checks whether
+ * its own object was flushed. Flushes are rare enough for this to be cheaper
+ * than a condition per object. */
+static pthread_mutex_t drain_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t drain_cond = PTHREAD_COND_INITIALIZER;
+
+static uint64_t
+now_ms(clockid_t clock)
+{
+	struct timespec now;
+	clock_gettime(clock, &now);
+	return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+uint64_t
+audio_drain_deadline(int timeout_ms)
+{
+	if (timeout_ms < 0)
+		return UINT64_MAX;
+	return now_ms(CLOCK_MONOTONIC) + timeout_ms;
+}
+
+int
+audio_drain_remaining(uint64_t deadline)
+{
+	if (deadline == UINT64_MAX)
+		return -1;
+
+	uint64_t now = now_ms(CLOCK_MONOTONIC);
+	if (now >= deadline)
+		return 0;
+	return deadline - now > INT_MAX ? INT_MAX : (int)(deadline - now);
+}
+
+void
+audio_drain_abstime(uint64_t deadline,
+                    struct timespec *ts)
+{
+	// The conditions use the default (realtime) clock.
+	int remaining = audio_drain_remaining(deadline);
+	uint64_t until = now_ms(CLOCK_REALTIME) + (remaining < 0 ? 0 : remaining);
+	ts->tv_sec = until / 1000;
+	ts->tv_nsec = (until % 1000) * 1000000;
+}
+
+int
+audio_drain_sleep(struct audio_object *object,
+                  uint64_t generation,
+                  uint32_t ms)
+{
+	struct timespec ts;
+	audio_drain_abstime(now_ms(CLOCK_MONOTONIC) + ms, &ts);
+
+	pthread_mutex_lock(&drain_mutex);
+	while (!audio_drain_cancelled(object, generation)) {
+		if (pthread_cond_timedwait(&drain_cond, &drain_mutex, &ts) == ETIMEDOUT)
+			break;
+	}
+	pthread_mutex_unlock(&drain_mutex);
+	return audio_drain_cancelled(object, generation) ? -ECANCELED : 0;
+}
+
+void
+audio_drain_cancel(struct audio_object *object)
+{
+	pthread_mutex_lock(&drain_mutex);
+	audio_counter_add(&object->drain_generation, 1);
+	pthread_mutex_unlock(&drain_mutex);
+
+	if (object->wake)
+		object->wake(object);
+
+	// Wait for the drainers to leave the backend, so the flush does not
+	// reset the device under them.
+	pthread_mutex_lock(&drain_mutex);
+	pthread_cond_broadcast(&drain_cond);
+	while (audio_counter_get(&object->drainers) != 0)
+		pthread_cond_wait(&drain_cond, &drain_mutex);
+	pthread_mutex_unlock(&drain_mutex);
+}
+
+/* Wait for the backend delay to count down. Some backends always report the
+ * latency of the device, so once the delay stops going down it is slept off
+ * once more instead of calling the blocking drain, which could not be
+ * interrupted by a flush or bounded by the deadline. */
+static int
+audio_drain_delay(struct audio_object *object,
+                  uint64_t deadline,
+                  uint64_t generation)
+{
+	uint32_t rate = object->device_rate ? object->device_rate : object->rate;
+	if (rate == 0) {
+		// Nothing has been played, so there is no delay to wait for.
+		if (audio_drain_cancelled(object, generation))
+			return -ECANCELED;
+		return deadline == UINT64_MAX ? object->drain(object) : -ENOSYS;
+	}
+
+	size_t last = SIZE_MAX;
+	for (;;) {
+		if (audio_drain_cancelled(object, generation))
+			return -ECANCELED;
+
+		size_t frames = 0;
+		int error = object->delay(object, &frames);
+		if (error != 0)
+			return error;
+		if (frames == 0)
+			return 0;
+
+		int remaining = audio_drain_remaining(deadline);
+		if (remaining == 0)
+			return -ETIMEDOUT;
+
+		uint32_t wait = (uint64_t)frames * 1000 / rate + 1;
+		if (remaining > 0 && (uint32_t)remaining < wait) {
+			// Check the delay again at the deadline.
+			if ((error = audio_drain_sleep(object, generation, remaining)) != 0)
+				return error;
+			continue;
+		}
+		if ((error = audio_drain_sleep(object, generation, wait)) != 0)
+			return error;
+		if (frames >= last)
+			return 0;
+		last = frames;
+	}
+}
+
+int
+audio_drain(struct audio_object *object,
+            uint64_t deadline,
+            uint64_t generation)
+{
+	int error;
+	if (!object->drain_until && !object->delay) {
+		// The drain cannot be interrupted or bounded.
+		if (audio_drain_cancelled(object, generation))
+			return -ECANCELED;
+		if (deadline != UINT64_MAX)
+			return -ENOSYS;
+		if ((error = audio_drain_write_tail(object)) != 0)
+			return error;
+		return object->drain(object);
+	}
+
+	// Checking for a flush and registering as a drainer under the mutex
+	// means audio_drain_cancel either sees this drainer or cancels it.
+	pthread_mutex_lock(&drain_mutex);
+	if (audio_drain_cancelled(object, generation)) {
+		pthread_mutex_unlock(&drain_mutex);
+		return -ECANCELED;
+	}
+	audio_counter_add(&object->drainers, 1);
+	pthread_mutex_unlock(&drain_mutex);
+
+	error = audio_drain_write_tail(object);
+	if (error == 0 && object->drain_until)
+		error = object->drain_until(object, deadline, generation);
+	else if (error == 0)
+		error = audio_drain_delay(object, deadline, generation);
+
+	pthread_mutex_lock(&drain_mutex);
+	audio_counter_sub(&object->drainers, 1);
+	pthread_cond_broadcast(&drain_cond);
+	pthread_mutex_unlock(&drain_mutex);
+	return error;
+}
+
+#else
+
+uint64_t
+audio_drain_deadline(int timeout_ms)
+{
+	return timeout_ms < 0 ? UINT64_MAX : 0;
+}
+
+int
+audio_drain_remaining(uint64_t deadline)
+{
+	return deadline == UINT64_MAX ? -1 : 0;
+}
+
+int
+audio_drain_sleep(struct audio_object *object,
+                  uint64_t generation,
+                  uint32_t ms)
+{
+	return -ENOSYS;
+}
+
+void
+audio_drain_cancel(struct audio_object *object)
+{
+	audio_counter_add(&object->drain_generation, 1);
+	if (object->wake)
+		object->wake(object);
+}
+
+int
+audio_drain(struct audio_object *object,
+            uint64_t deadline,
+            uint64_t generation)
+{
+	if (audio_drain_cancelled(object, generation))
+		return -ECANCELED;
+
+	int error = audio_drain_write_tail(object);
+	if (error != 0)
+		return error;
+
+	if (object->drain_until)
+		return object->drain_until(object, deadline, generation);
+	if (deadline != UINT64_MAX)
+		return -ENOSYS;
+	return object->drain(object);
+}
+
+#endif
@@ -109,11 +109,514 @@ const char *
 audio_object_strerror(struct audio_object *object,
                       int error);
 
+/* Thread safety.
+ *
+ * An audio object is written to by one thread at a time: audio_object_write,
+ * audio_object_drain and the other functions that queue audio must not be
+ * called for the same object from different threads at the same time.
+ *
+ * audio_object_flush can be called from any thread while another is in
+ * audio_object_write or a drain. The writes in progress stop waiting for the
+ * device and return -ECANCELED, discarding the rest of their audio, as do
+ * writes that start while the flush is running. The flush waits for them to
+ * leave the backend before discarding the audio in the device, so the device
+ * is never reset or reopened under a write. Writes that start after the
+ * flush returns are played as normal. Flushes of the same object from
+ * several threads are combined into one.
+ *
+ * Writes that are not waiting for the device (and backends that cannot be
+ * woken, such as OSS) finish what they are doing before the flush goes
+ * ahead. audio_object_begin_write and audio_object_commit, and opening,
+ * closing and destroying the object, must not be called at the same time as
+ * a flush.
+ */
+
+/* Interruptible drain.
+ *
+ * audio_object_drain_timeout waits up to timeout_ms milliseconds (or without
+ * a limit if it is negative) for the audio to be played, returning -ETIMEDOUT
+ * if it has not been. The audio keeps playing, and can be waited for again or
+ * flushed. Backends that cannot report the playback progress return -ENOSYS
+ * unless timeout_ms is negative.
+ *
+ * audio_object_drain_async queues a drain behind the buffers passed to
+ * audio_object_write_async, and returns straight away. `callback` is called
+ * from the feeder thread with a NULL buffer once the audio has been played,
+ * with the drain's status.
+ *
+ * A call to audio_object_flush from another thread interrupts the drains in
+ * progress, which return (or pass to their callback) -ECANCELED.
+ */
+
+int
+audio_object_drain_timeout(struct audio_object *object,
+                           int timeout_ms);
+
+/* Device buffering.
+ *
+ * audio_object_set_buffering sets the period (wakeup interval), number of
+ * periods and target latency (buffer length) used by the next call to
+ * audio_object_open. A value of 0 leaves that parameter to the backend. The
+ * values negotiated with the device are returned by audio_object_get_buffering
+ * once the object is open; values the backend does not report are 0.
+ */
+
+int
+audio_object_set_buffering(struct audio_object *object,
+                           uint32_t period_us,
+                           uint32_t periods,
+                           uint32_t latency_us);
+
+int
+audio_object_get_buffering(struct audio_object *object,
+                           uint32_t *period_us,
+                           uint32_t *periods,
+                           uint32_t *latency_us);
+
+/* Start and wakeup thresholds.
+ *
+ * audio_object_set_thresholds sets, for the next call to audio_object_open:
+ *
+ *   start_us      the audio written before playback starts. 0 leaves this to
+ *                 the backend -- a full buffer on ALSA -- and
+ *                 AUDIO_OBJECT_START_IMMEDIATE starts playback as soon as a
+ *                 period has been written, for the lowest response latency.
+ *   avail_min_us  the space needed in the buffer before a blocked write (or
+ *                 audio_object_get_pollfds) wakes up. 0 is a period.
+ *   silence_us    fill the buffer with silence when less than this is
+ *                 queued, so an underrun plays silence instead of old audio.
+ *                 0 disables it.
+ *
+ * ALSA uses all three. PulseAudio uses start_us as the stream's prebuf and
+ * avail_min_us as its minreq. The other backends ignore them.
+ */
+
+#define AUDIO_OBJECT_START_IMMEDIATE UINT32_MAX
+
+int
+audio_object_set_thresholds(struct audio_object *object,
+                            uint32_t start_us,
+                            uint32_t avail_min_us,
+                            uint32_t silence_us);
+
+/* Warm standby.
+ *
+ * audio_object_set_standby keeps the device open for idle_ms after
+ * audio_object_close, so an object that is opened and closed around each
+ * utterance does not pay for opening and configuring the device every time.
+ * The queued audio is discarded by the close as before, and the device is
+ * left stopped: ALSA devices are left prepared, PulseAudio streams corked
+ * and PipeWire streams inactive, so no silence is played while idle.
+ *
+ * An audio_object_open with the same format, rate and channels before the
+ * time runs out returns straight away. Otherwise the device is closed when
+ * the time runs out, by the next open, by audio_object_destroy or by setting
+ * idle_ms to 0 (the default). Changing the buffering, thresholds, resample
+ * quality or channel map while in standby reopens the device on the next
+ * open.
+ */
+
+int
+audio_object_set_standby(struct audio_object *object,
+                         uint32_t idle_ms);
+
+/* Device handle pool.
+ *
+ * audio_pool_set_limit keeps up to `handles` devices closed by any audio
+ * object in the process open for reuse. An audio_object_open on the same
+ * backend and device, with the same format, rate, channels, buffering,
+ * thresholds and resample quality (and for PulseAudio, the same application
+ * name and description), takes a matching handle from the pool instead of
+ * opening and configuring the device. When the pool is full, the least
+ * recently used handle is closed. ALSA PCMs and PulseAudio streams are
+ * pooled; the other backends close their devices as before.
+ *
+ * The limit is 0 (no pool) unless it is set here or with the
+ * PCAUDIO_POOL_SIZE environment variable. Setting it lower closes the extra
+ * handles. A child process created with fork does not inherit the pool: the
+ * handles belong to the parent, so the child forgets them without closing
+ * them.
+ */
+
+int
+audio_pool_set_limit(size_t handles);
+
+/* Sample rate conversion.
+ *
+ * If the device is opened at a different rate to the one passed to
+ * audio_object_open, the audio is resampled to the device rate. The quality
+ * used is set by audio_object_set_resample_quality before the object is
+ * opened. AUDIO_OBJECT_RESAMPLE_NONE plays the audio at the device rate
+ * without resampling it. Selecting a quality level also stops ALSA from
+ * resampling in the plug layer, so the audio is resampled once.
+ *
+ * audio_object_get_device_format returns the format, rate and number of
+ * channels the device was opened with.
+ */
+
+enum audio_object_resample_quality
+{
+	AUDIO_OBJECT_RESAMPLE_DEFAULT, /* AUDIO_OBJECT_RESAMPLE_MEDIUM if the rates differ */
+	AUDIO_OBJECT_RESAMPLE_NONE,
+	AUDIO_OBJECT_RESAMPLE_FAST,    /* 16 tap filter, ~60dB stopband */
+	AUDIO_OBJECT_RESAMPLE_MEDIUM,  /* 32 tap filter, ~80dB stopband */
+	AUDIO_OBJECT_RESAMPLE_BEST,    /* 64 tap filter, ~100dB stopband */
+};
+
+int
+audio_object_set_resample_quality(struct audio_object *object,
+                                  enum audio_object_resample_quality quality);
+
+int
+audio_object_get_device_format(struct audio_object *object,
+                               enum audio_object_format *format,
+                               uint32_t *rate,
+                               uint8_t *channels);
+
+/* Channel mapping.
+ *
+ * audio_object_set_channel_map opens the device with out_channels channels
+ * when audio_object_open is called with in_channels channels, mixing each
+ * frame with `matrix` -- out_channels rows of in_channels gains. If matrix is
+ * NULL, or the device does not support the number of channels passed to
+ * audio_object_open, a default mapping is used: mono is copied to every
+ * channel except the LFE, 5.1 and 7.1 are downmixed to stereo, anything is
+ * averaged to mono, and otherwise the channels common to both are kept.
+ * Channels are in the ALSA/WAVE order (FL, FR, FC, LFE, RL, RR, SL, SR).
+ * Passing out_channels as 0 removes the mapping.
+ */
+
+int
+audio_object_set_channel_map(struct audio_object *object,
+                             uint8_t in_channels,
+                             uint8_t out_channels,
+                             const float *matrix);
+
+/* Playback progress.
+ *
+ * audio_object_get_delay returns the number of frames that have been written
+ * (including any queued by audio_object_write_async) but not yet played, and
+ * audio_object_get_position the number of frames played since the object was
+ * opened. Backends that cannot report this return -ENOSYS.
+ */
+
+int
+audio_object_get_delay(struct audio_object *object,
+                       size_t *frames);
+
+int
+audio_object_get_position(struct audio_object *object,
+                          uint64_t *frames);
+
+/* Event loop integration.
+ *
+ * audio_object_get_pollfds fills `fds` with up to `space` descriptors to
+ * wait on with poll or epoll, returning the number filled, or the number
+ * needed if fds is NULL. When one of them is ready, pass the revents of
+ * every descriptor to audio_object_service. It recovers the device from
+ * underruns and returns in `frames` the number of frames that
+ * audio_object_write can write without blocking, so a single thread can
+ * keep many audio objects fed. The descriptors can change when the object
+ * is opened or flushed. Backends that do not have descriptors to wait on
+ * return -ENOSYS.
+ *
+ * The fields of audio_object_pollfd have the same meaning as those of
+ * struct pollfd.
+ */
+
+struct audio_object_pollfd
+{
+	int fd;
+	short events;
+	short revents;
+};
+
+int
+audio_object_get_pollfds(struct audio_object *object,
+                         struct audio_object_pollfd *fds,
+                         unsigned int space);
+
+int
+audio_object_service(struct audio_object *object,
+                     const struct audio_object_pollfd *fds,
+                     unsigned int nfds,
+                     size_t *frames);
+
+/* Zero-copy writes.
+ *
+ * audio_object_begin_write returns a buffer for up to `*frames` frames (any
+ * number if `*frames` is 0) that the caller fills before passing the number of
+ * frames written to audio_object_commit. Where the backend supports it, this
+ * is the device or server buffer; otherwise it is an internal staging buffer
+ * that is written to the device on commit.
+ *
+ * If the device could not queue all the frames (for example after an
+ * underrun), audio_object_commit returns an error such as -EPIPE and the
+ * frames are not counted as written, so the caller should render them again.
+ */
+
+int
+audio_object_begin_write(struct audio_object *object,
+                         void **data,
+                         size_t *frames);
+
+int
+audio_object_commit(struct audio_object *object,
+                    size_t frames);
+
+/* Asynchronous writes.
+ *
+ * Buffers passed to audio_object_write_async are queued and written to the
+ * device by a feeder thread owned by the audio object, so the caller does not
+ * block while the device plays the audio. Errors reported by the queue itself
+ * are negative errno values.
+ */
+
+enum audio_object_async_policy
+{
+	AUDIO_OBJECT_ASYNC_BLOCK,       /* wait for space in the queue */
+	AUDIO_OBJECT_ASYNC_FAIL,        /* return -EAGAIN when the queue is full */
+	AUDIO_OBJECT_ASYNC_DROP_OLDEST, /* discard the oldest queued buffer, or wait
+	                                   if the oldest request is a drain */
+};
+
+/* Copy the data instead of referencing it until the callback is called. */
+#define AUDIO_OBJECT_ASYNC_COPY 1
+
+/* Called once a buffer has been written (status is 0), failed (status is the
+ * backend error), was flushed (-ECANCELED) or was dropped to make space in
+ * the queue (-ENOBUFS). The callback is called from the feeder thread, except
+ * for -ENOBUFS, which is called from the thread calling
+ * audio_object_write_async that needed the space.
+ *
+ * The callback can call audio_object_flush. It must not call the functions
+ * that wait for the feeder thread, as the feeder cannot wait for itself:
+ * audio_object_set_async, audio_object_destroy, audio_object_write,
+ * audio_object_begin_write and audio_object_drain_timeout, or
+ * audio_object_write_async and audio_object_drain_async if they would wait
+ * for space in the queue.
+ */
+typedef void (*audio_object_write_callback)(struct audio_object *object,
+                                            const void *data,
+                                            size_t bytes,
+                                            int status,
+                                            void *userdata);
+
+/* The queue length is rounded up to a power of two (at least 2). Changing the
+ * length waits for the queued buffers to be written and recreates the queue;
+ * changing only the policy takes effect straight away.
+ */
+int
+audio_object_set_async(struct audio_object *object,
+                       size_t queue_length,
+                       enum audio_object_async_policy policy);
+
+int
+audio_object_write_async(struct audio_object *object,
+                         const void *data,
+                         size_t bytes,
+                         int flags,
+                         audio_object_write_callback callback,
+                         void *userdata);
+
+int
+audio_object_drain_async(struct audio_object *object,
+                         audio_object_write_callback callback,
+                         void *userdata);
+
+/* Software mixing.
+ *
+ * audio_mixer_create opens `device` as 16-bit audio at the given rate and
+ * number of channels, and mixes the streams created by
+ * audio_mixer_create_stream into it from a mixer thread. The streams are
+ * audio objects that can be opened with any format, rate and number of
+ * channels, and are converted to the mixer's format. This allows several
+ * voices to play at the same time on a device that only supports a single
+ * client, such as an ALSA hw device.
+ *
+ * The streams are mixed with saturating adds, after applying the gain set by
+ * audio_object_set_gain (0.0 to 1.0). audio_mixer_destroy closes the device,
+ * but does not destroy it. Streams should be destroyed before the mixer; any
+ * that are not return -ENODEV from then on.
+ */
+
+struct audio_mixer;
+
+struct audio_mixer *
+audio_mixer_create(struct audio_object *device,
+                   uint32_t rate,
+                   uint8_t channels);
+
+void
+audio_mixer_destroy(struct audio_mixer *mixer);
+
+struct audio_object *
+audio_mixer_create_stream(struct audio_mixer *mixer);
+
+/* Priority streams.
+ *
+ * audio_mixer_set_priority sets the priority of a mixer stream (0 by
+ * default), and what it does to lower priority streams while it has audio
+ * to play:
+ *
+ *   AUDIO_MIXER_PREEMPT  the lower priority streams are paused, keeping
+ *                        their queued audio, and resume from the frame after
+ *                        the last frame of this stream's audio.
+ *   AUDIO_MIXER_DUCK     the lower priority streams keep playing at the
+ *                        gain set by audio_mixer_set_ducking, ramped down
+ *                        and back up so the change is smooth.
+ *
+ * The mixing is done in the mixer thread, so higher priority audio is mixed
+ * into the next period (10ms) written to the device without flushing or
+ * reopening it. The time before it is heard is that plus the audio already
+ * queued in the device, which can be kept low by calling
+ * audio_object_set_buffering on the device before audio_mixer_create.
+ *
+ * audio_mixer_set_ducking sets the gain of ducked streams (0.0 to 1.0,
+ * default 0.25) and the time to ramp to it (default 50ms).
+ */
+
+enum audio_mixer_priority_mode
+{
+	AUDIO_MIXER_PREEMPT,
+	AUDIO_MIXER_DUCK,
+};
+
+int
+audio_mixer_set_priority(struct audio_object *stream,
+                         int priority,
+                         enum audio_mixer_priority_mode mode);
+
+int
+audio_mixer_set_ducking(struct audio_mixer *mixer,
+                        float gain,
+                        uint32_t ramp_ms);
+
+/* Set the gain applied to the audio. Backends that do not support this
+ * return -ENOSYS. */
+int
+audio_object_set_gain(struct audio_object *object,
+                      float gain);
+
+/* Runtime statistics.
+ *
+ * audio_object_get_stats returns counters kept since the object was created.
+ * bytes_written and frames_written are in the format passed to
+ * audio_object_open. underruns, suspends, prepares (snd_pcm_prepare calls)
+ * and short_writes (writes the device only partly accepted) are counted by
+ * the backends that can detect them. write_latency is a histogram of the
+ * time each write took: bucket 0 counts writes under 1us, bucket i writes
+ * from 2^(i-1) up to 2^i us, and the last bucket any longer writes.
+ * max_blocked_us is the longest write. flush_latency and max_flush_us are
+ * the same for the time audio_object_flush took. The counters are updated with relaxed
+ * atomics, so each is exact but they are not a consistent snapshot.
+ */
+
+#define AUDIO_OBJECT_LATENCY_BUCKETS 24
+
+struct audio_object_stats
+{
+	uint64_t bytes_written;
+	uint64_t frames_written;
+	uint64_t writes;
+	uint64_t errors;
+	uint64_t underruns;
+	uint64_t suspends;
+	uint64_t prepares;
+	uint64_t short_writes;
+	uint64_t max_blocked_us;
+	uint64_t write_latency[AUDIO_OBJECT_LATENCY_BUCKETS];
+	uint64_t flushes;
+	uint64_t max_flush_us;
+	uint64_t flush_latency[AUDIO_OBJECT_LATENCY_BUCKETS];
+};
+
+int
+audio_object_get_stats(struct audio_object *object,
+                       struct audio_object_stats *stats);
+
+/* Underrun and suspend recovery.
+ *
+ * audio_object_set_xrun_policy selects what a write does when the device
+ * has run out of audio (an underrun) or was suspended:
+ *
+ *   AUDIO_OBJECT_XRUN_REPLAY  restarts the device and writes the audio.
+ *   AUDIO_OBJECT_XRUN_PRIME   also writes a period of silence first, so the
+ *                             device does not run out again straight away.
+ *   AUDIO_OBJECT_XRUN_SKIP    drops the audio that would have played while
+ *                             the device was stopped, so the audio keeps in
+ *                             time with the clock.
+ *   AUDIO_OBJECT_XRUN_FAIL    restarts the device, but returns the error
+ *                             (-EPIPE or -ESTRPIPE) from the write without
+ *                             writing the rest of the audio.
+ *
+ * A suspended device is resumed with a backoff that gives up after a
+ * fraction of a second, restarting the device instead. A flush interrupts
+ * the backoff.
+ *
+ * The callback set with audio_object_set_xrun_callback is called from the
+ * writing thread once the device has recovered, with the status of the
+ * recovery and the time it took.
+ *
+ * This is only supported by the ALSA backend; the others ignore it.
+ */
+
+enum audio_object_xrun_policy
+{
+	AUDIO_OBJECT_XRUN_REPLAY,
+	AUDIO_OBJECT_XRUN_PRIME,
+	AUDIO_OBJECT_XRUN_SKIP,
+	AUDIO_OBJECT_XRUN_FAIL,
+};
+
+enum audio_object_xrun_type
+{
+	AUDIO_OBJECT_XRUN_UNDERRUN,
+	AUDIO_OBJECT_XRUN_SUSPEND,
+};
+
+typedef void (*audio_object_xrun_callback)(struct audio_object *object,
+                                           enum audio_object_xrun_type type,
+                                           int status,
+                                           uint32_t recovery_us,
+                                           void *userdata);
+
+int
+audio_object_set_xrun_policy(struct audio_object *object,
+                             enum audio_object_xrun_policy policy);
+
+int
+audio_object_set_xrun_callback(struct audio_object *object,
+                               audio_object_xrun_callback callback,
+                               void *userdata);
+
 struct audio_object *
 create_audio_device_object(const char *device,
                            const char *application_name,
                            const char *description);
 
+/* Create an audio object using the named backend ("pipewire", "pulseaudio",
+ * "pulseaudio-simple", "alsa", "qsa", "oss", "coreaudio", "xaudio2" or
+ * "null"), or a comma separated list of backends to try in order. If backend
+ * is NULL, the PCAUDIO_BACKEND environment variable is used if set, otherwise
+ * all the available backends are tried as in create_audio_device_object.
+ *
+ * The "pulseaudio-simple" and "null" backends are only used when they are
+ * named. "pulseaudio-simple" uses the PulseAudio simple API instead of the
+ * asynchronous one. "null" discards the audio, playing it at the real-time
+ * rate so writes, the delay and the position behave as they do for a sound
+ * card, or as fast as it is written if the device is "unlimited".
+ */
+struct audio_object *
+create_audio_device_object_ex(const char *backend,
+                              const char *device,
+                              const char *application_name,
+                              const char *description);
+
+/* The name of the backend used by the audio object. */
+const char *
+audio_object_get_backend(struct audio_object *object);
+
 #ifdef __cplusplus
 }
 #endif
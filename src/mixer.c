@@ -0,0 +1,893 @@
+/* Software Mixer.
+ *
+ * Copyright (C) 2026 Reece H. Dunn
+ *
+ * This file is part of pcaudiolib.
+ *
+ * pcaudiolib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pcaudiolib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pcaudiolib.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "audio_priv.h"
+
+#include <errno.h>
+#include <string.h>
+
+#if defined(HAVE_PTHREAD_H)
+
+#include <pthread.h>
+#include <time.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) && defined(__aarch64__) && defined(__ARM_NEON)
+#define HAVE_NEON_KERNELS
+#include <arm_neon.h>
+#endif
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define MIXER_FORMAT AUDIO_OBJECT_FORMAT_S16BE
+#else
+#define MIXER_FORMAT AUDIO_OBJECT_FORMAT_S16LE
+#endif
+
+/* The mixer writes to the device in periods of 10ms. */
+#define MIXER_PERIODS_PER_SECOND 100
+
+/* Gains are applied as Q15 fixed point. */
+#define GAIN_UNITY 32768
+
+/* Streams are ducked to a quarter of their gain over 50ms by default. */
+#define DEFAULT_DUCK_GAIN (GAIN_UNITY / 4)
+#define DEFAULT_DUCK_RAMP_MS 50
+
+/* ------------------------------------------------------------------------- */
+/* Mixing kernels                                                            */
+
+static inline int16_t
+saturate16(int32_t x)
+{
+	return x < -32768 ? -32768 : (x > 32767 ? 32767 : x);
+}
+
+static inline int16_t
+scale16(int16_t x, int32_t gain)
+{
+	return gain == GAIN_UNITY ? x : (int16_t)(((int32_t)x * gain + 0x4000) >> 15);
+}
+
+static void
+scalar_mix16(int16_t *out, const int16_t *in, size_t n, int32_t gain)
+{
+	for (size_t i = 0; i < n; ++i)
+		out[i] = saturate16((int32_t)out[i] + scale16(in[i], gain));
+}
+
+#ifdef HAVE_X86_KERNELS
+
+__attribute__((target("ssse3")))
+static void
+ssse3_mix16(int16_t *out, const int16_t *in, size_t n, int32_t gain)
+{
+	size_t i = 0;
+	if (gain == GAIN_UNITY) {
+		for (; i + 8 <= n; i += 8) {
+			__m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+			__m128i y = _mm_loadu_si128((const __m128i *)(out + i));
+			_mm_storeu_si128((__m128i *)(out + i), _mm_adds_epi16(y, x));
+		}
+	} else {
+		const __m128i g = _mm_set1_epi16((int16_t)gain);
+		for (; i + 8 <= n; i += 8) {
+			__m128i x = _mm_mulhrs_epi16(_mm_loadu_si128((const __m128i *)(in + i)), g);
+			__m128i y = _mm_loadu_si128((const __m128i *)(out + i));
+			_mm_storeu_si128((__m128i *)(out + i), _mm_adds_epi16(y, x));
+		}
+	}
+	scalar_mix16(out + i, in + i, n - i, gain);
+}
+
+__attribute__((target("avx2")))
+static void
+avx2_mix16(int16_t *out, const int16_t *in, size_t n, int32_t gain)
+{
+	size_t i = 0;
+	if (gain == GAIN_UNITY) {
+		for (; i + 16 <= n; i += 16) {
+			__m256i x = _mm256_loadu_si256((const __m256i *)(in + i));
+			__m256i y = _mm256_loadu_si256((const __m256i *)(out + i));
+			_mm256_storeu_si256((__m256i *)(out + i), _mm256_adds_epi16(y, x));
+		}
+	} else {
+		const __m256i g = _mm256_set1_epi16((int16_t)gain);
+		for (; i + 16 <= n; i += 16) {
+			__m256i x = _mm256_mulhrs_epi16(_mm256_loadu_si256((const __m256i *)(in + i)), g);
+			__m256i y = _mm256_loadu_si256((const __m256i *)(out + i));
+			_mm256_storeu_si256((__m256i *)(out + i), _mm256_adds_epi16(y, x));
+		}
+	}
+	scalar_mix16(out + i, in + i, n - i, gain);
+}
+
+#endif
+
+#ifdef HAVE_NEON_KERNELS
+
+static void
+neon_mix16(int16_t *out, const int16_t *in, size_t n, int32_t gain)
+{
+	size_t i = 0;
+	if (gain == GAIN_UNITY) {
+		for (; i + 8 <= n; i += 8)
+			vst1q_s16(out + i, vqaddq_s16(vld1q_s16(out + i), vld1q_s16(in + i)));
+	} else {
+		for (; i + 8 <= n; i += 8)
+			vst1q_s16(out + i, vqaddq_s16(vld1q_s16(out + i), vqrdmulhq_n_s16(vld1q_s16(in + i), (int16_t)gain)));
+	}
+	scalar_mix16(out + i, in + i, n - i, gain);
+}
+
+#endif
+
+static void (*mix16)(int16_t *out, const int16_t *in, size_t n, int32_t gain) = scalar_mix16;
+
+static void
+select_kernels(void)
+{
+#if defined(HAVE_X86_KERNELS)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("ssse3"))
+		mix16 = ssse3_mix16;
+	if (__builtin_cpu_supports("avx2"))
+		mix16 = avx2_mix16;
+#elif defined(HAVE_NEON_KERNELS)
+	mix16 = neon_mix16;
+#endif
+}
+
+/* ------------------------------------------------------------------------- */
+/* Mixer                                                                     */
+
+struct mixer_stream;
+
+struct audio_mixer
+{
+	struct audio_object *device;
+	uint32_t rate;
+	uint8_t channels;
+	size_t period;       // frames
+	int16_t *buffer;
+
+	struct mixer_stream *streams; // highest priority first
+	int32_t duck_gain;
+	int32_t duck_step;    // per frame
+
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;  // the mixer thread waits for data, destroy for calls
+	int stop;
+	int error;            // the last error writing to the device
+
+	/* The mixer is freed when it and all its streams have been destroyed, so
+	 * a stream's mixer pointer stays valid. Once destroyed it is detached,
+	 * and the stream calls fail with -ENODEV. */
+	int refs;
+	int detached;
+	int calls;            // stream calls in progress
+};
+
+/* The streams are audio objects that write to a ring buffer in the mixer
+ * format, converted by audio.c. All the fields after mixer are protected
+ * by the mixer mutex.
+ */
+struct mixer_stream
+{
+	struct audio_object vtable;
+	struct audio_mixer *mixer;
+	struct mixer_stream *next;
+
+	int16_t *ring;
+	size_t capacity;      // frames
+	size_t read;
+	size_t fill;
+	size_t mixing;        // frames taken by the mixer that are being written
+	int32_t gain;
+	int32_t duck;         // ducking gain, ramped towards the target
+	int priority;
+	enum audio_mixer_priority_mode mode;
+	int is_open;
+
+	pthread_cond_t cond;  // the writer waits for space, or drain to finish
+};
+
+#define to_mixer_stream(object) container_of(object, struct mixer_stream, vtable)
+
+static int32_t
+mixer_stream_gain(const struct mixer_stream *stream)
+{
+	if (stream->duck == GAIN_UNITY)
+		return stream->gain;
+	return (int32_t)(((int64_t)stream->gain * stream->duck + 0x4000) >> 15);
+}
+
+static int32_t
+ramp(int32_t current, int32_t target, int32_t step)
+{
+	if (current < target)
+		return target - current > step ? current + step : target;
+	return current - target > step ? current - step : target;
+}
+
+/* Mix `count` frames of the stream into the mixer buffer from frame `start`,
+ * ramping its ducking gain towards the mixer's duck_gain before frame
+ * `duck_end` and back towards unity after it.
+ */
+static void
+mixer_mix_stream(struct audio_mixer *mixer,
+                 struct mixer_stream *stream,
+                 size_t start,
+                 size_t count,
+                 size_t duck_end)
+{
+	size_t channels = mixer->channels;
+	size_t pos = start;
+	size_t end = start + count;
+	while (pos < end) {
+		int32_t target = pos < duck_end ? mixer->duck_gain : GAIN_UNITY;
+		size_t n = (pos < duck_end && duck_end < end ? duck_end : end) - pos;
+		// The ring buffer may wrap around.
+		if (n > stream->capacity - stream->read)
+			n = stream->capacity - stream->read;
+
+		int16_t *out = mixer->buffer + pos * channels;
+		const int16_t *in = stream->ring + stream->read * channels;
+		size_t i = 0;
+		for (; i < n && stream->duck != target; ++i) {
+			// Ramp the gain a frame at a time so the change is smooth.
+			stream->duck = ramp(stream->duck, target, mixer->duck_step);
+			scalar_mix16(out + i * channels, in + i * channels, channels, mixer_stream_gain(stream));
+		}
+		if (i < n)
+			mix16(out + i * channels, in + i * channels, (n - i) * channels, mixer_stream_gain(stream));
+
+		stream->read = (stream->read + n) % stream->capacity;
+		pos += n;
+	}
+}
+
+/* The streams are sorted by priority. Streams that preempt lower priority
+ * ones push the audio of those streams back to the frame after their own
+ * audio ends, leaving the rest queued, so a preempted stream resumes at the
+ * exact frame an alert finishes. Streams that duck lower priority ones lower
+ * the gain of those streams for the frames their own audio covers. Streams
+ * with the same priority do not affect each other.
+ */
+static size_t
+mixer_mix(struct audio_mixer *mixer)
+{
+	size_t frames = 0;
+	struct mixer_stream *stream;
+	for (stream = mixer->streams; stream; stream = stream->next)
+		if (stream->fill > frames)
+			frames = stream->fill;
+	if (frames > mixer->period)
+		frames = mixer->period;
+	if (frames == 0)
+		return 0;
+
+	memset(mixer->buffer, 0, frames * mixer->channels * sizeof(int16_t));
+	size_t preempt_end = 0, duck_end = 0;     // from higher priority streams
+	size_t group_preempt = 0, group_duck = 0; // from streams at this priority
+	for (stream = mixer->streams; stream; stream = stream->next) {
+		size_t start = preempt_end;
+		size_t count = stream->fill < frames - start ? stream->fill : frames - start;
+		mixer_mix_stream(mixer, stream, start, count, duck_end);
+		stream->fill -= count;
+		stream->mixing = count;
+
+		size_t *group_end = stream->mode == AUDIO_MIXER_DUCK ? &group_duck : &group_preempt;
+		if (count && start + count > *group_end)
+			*group_end = start + count;
+		if (!stream->next || stream->next->priority != stream->priority) {
+			if (group_preempt > preempt_end)
+				preempt_end = group_preempt;
+			if (group_duck > duck_end)
+				duck_end = group_duck;
+		}
+	}
+	return frames;
+}
+
+// Add the stream to the mixer after the streams with the same or a higher
+// priority. Must be called with the mixer mutex held.
+static void
+mixer_insert(struct audio_mixer *mixer,
+             struct mixer_stream *stream)
+{
+	struct mixer_stream **item = &mixer->streams;
+	while (*item && (*item)->priority >= stream->priority)
+		item = &(*item)->next;
+	stream->next = *item;
+	*item = stream;
+}
+
+// Remove the stream from the mixer. Must be called with the mixer mutex held.
+static void
+mixer_remove(struct audio_mixer *mixer,
+             struct mixer_stream *stream)
+{
+	struct mixer_stream **item;
+	for (item = &mixer->streams; *item; item = &(*item)->next)
+		if (*item == stream) {
+			*item = stream->next;
+			break;
+		}
+}
+
+static void
+mixer_set_duck_ramp(struct audio_mixer *mixer,
+                    uint32_t ramp_ms)
+{
+	uint64_t frames = (uint64_t)mixer->rate * ramp_ms / 1000;
+	int32_t range = GAIN_UNITY - mixer->duck_gain;
+	mixer->duck_step = frames ? (int32_t)(range / frames) : GAIN_UNITY;
+	if (mixer->duck_step < 1)
+		mixer->duck_step = 1;
+}
+
+/* Drop a reference to the mixer, freeing it if it was the last one. Must be
+ * called with the mixer mutex held, which it unlocks. */
+static void
+mixer_release(struct audio_mixer *mixer)
+{
+	int last = --mixer->refs == 0;
+	pthread_mutex_unlock(&mixer->mutex);
+	if (!last)
+		return;
+
+	pthread_cond_destroy(&mixer->cond);
+	pthread_mutex_destroy(&mixer->mutex);
+	free(mixer->buffer);
+	free(mixer);
+}
+
+/* Start a stream call, locking the mixer mutex, or return NULL if the mixer
+ * has been destroyed. A successful call is matched by mixer_leave. */
+static struct audio_mixer *
+mixer_enter(struct mixer_stream *stream)
+{
+	struct audio_mixer *mixer = stream->mixer;
+	pthread_mutex_lock(&mixer->mutex);
+	if (mixer->detached) {
+		pthread_mutex_unlock(&mixer->mutex);
+		return NULL;
+	}
+	++mixer->calls;
+	return mixer;
+}
+
+/* End a stream call, unlocking the mixer mutex. */
+static void
+mixer_leave(struct audio_mixer *mixer)
+{
+	if (--mixer->calls == 0 && mixer->detached)
+		pthread_cond_broadcast(&mixer->cond);
+	pthread_mutex_unlock(&mixer->mutex);
+}
+
+static void *
+mixer_thread(void *arg)
+{
+	struct audio_mixer *mixer = arg;
+	struct mixer_stream *stream;
+
+	pthread_mutex_lock(&mixer->mutex);
+	while (!mixer->stop) {
+		size_t frames = mixer_mix(mixer);
+		if (frames == 0) {
+			pthread_cond_wait(&mixer->cond, &mixer->mutex);
+			continue;
+		}
+		for (stream = mixer->streams; stream; stream = stream->next)
+			pthread_cond_broadcast(&stream->cond);
+		pthread_mutex_unlock(&mixer->mutex);
+
+		// Writing to the device blocks until it has space, which paces the
+		// mixer at the device rate.
+		int error = audio_object_write(mixer->device, mixer->buffer,
+		                               frames * mixer->channels * sizeof(int16_t));
+
+		pthread_mutex_lock(&mixer->mutex);
+		mixer->error = error;
+		for (stream = mixer->streams; stream; stream = stream->next) {
+			stream->mixing = 0;
+			pthread_cond_broadcast(&stream->cond);
+		}
+	}
+	pthread_mutex_unlock(&mixer->mutex);
+	return NULL;
+}
+
+struct audio_mixer *
+audio_mixer_create(struct audio_object *device,
+                   uint32_t rate,
+                   uint8_t channels)
+{
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	pthread_once(&once, select_kernels);
+
+	if (!device || rate == 0 || channels == 0)
+		return NULL;
+
+	struct audio_mixer *mixer = calloc(1, sizeof(struct audio_mixer));
+	if (!mixer)
+		return NULL;
+
+	mixer->device = device;
+	mixer->rate = rate;
+	mixer->channels = channels;
+	mixer->period = rate / MIXER_PERIODS_PER_SECOND;
+	if (mixer->period == 0)
+		mixer->period = 1;
+	mixer->duck_gain = DEFAULT_DUCK_GAIN;
+	mixer_set_duck_ramp(mixer, DEFAULT_DUCK_RAMP_MS);
+	mixer->buffer = malloc(mixer->period * channels * sizeof(int16_t));
+	if (!mixer->buffer) {
+		free(mixer);
+		return NULL;
+	}
+
+	if (audio_object_open(device, MIXER_FORMAT, rate, channels) != 0) {
+		free(mixer->buffer);
+		free(mixer);
+		return NULL;
+	}
+
+	mixer->refs = 1;
+	pthread_mutex_init(&mixer->mutex, NULL);
+	pthread_cond_init(&mixer->cond, NULL);
+	if (pthread_create(&mixer->thread, NULL, mixer_thread, mixer) != 0) {
+		audio_object_close(device);
+		pthread_cond_destroy(&mixer->cond);
+		pthread_mutex_destroy(&mixer->mutex);
+		free(mixer->buffer);
+		free(mixer);
+		return NULL;
+	}
+	return mixer;
+}
+
+void
+audio_mixer_destroy(struct audio_mixer *mixer)
+{
+	if (!mixer)
+		return;
+
+	pthread_mutex_lock(&mixer->mutex);
+	mixer->stop = 1;
+	pthread_cond_broadcast(&mixer->cond);
+	pthread_mutex_unlock(&mixer->mutex);
+	pthread_join(mixer->thread, NULL);
+
+	// Detach any streams that have not been destroyed, and wait for the
+	// calls blocked in them to return before closing the device.
+	struct mixer_stream *stream;
+	pthread_mutex_lock(&mixer->mutex);
+	mixer->detached = 1;
+	for (stream = mixer->streams; stream; stream = stream->next)
+		pthread_cond_broadcast(&stream->cond);
+	while (mixer->calls != 0)
+		pthread_cond_wait(&mixer->cond, &mixer->mutex);
+	pthread_mutex_unlock(&mixer->mutex);
+
+	audio_object_drain(mixer->device);
+	audio_object_close(mixer->device);
+
+	pthread_mutex_lock(&mixer->mutex);
+	mixer_release(mixer);
+}
+
+/* ------------------------------------------------------------------------- */
+/* Mixer streams                                                             */
+
+static int
+mixer_stream_open(struct audio_object *object,
+                  enum audio_object_format format,
+                  uint32_t rate,
+                  uint8_t channels)
+{
+	struct mixer_stream *self = to_mixer_stream(object);
+	struct audio_mixer *mixer = mixer_enter(self);
+	if (!mixer)
+		return -ENODEV;
+
+	// Buffer the requested latency in the stream.
+	uint32_t latency_us = object->buffering.latency_us;
+	if (!latency_us)
+		latency_us = object->buffering.period_us * (object->buffering.periods ? object->buffering.periods : 1);
+	if (!latency_us)
+		latency_us = DEFAULT_LATENCY_US;
+	size_t capacity = (size_t)((uint64_t)mixer->rate * latency_us / 1000000);
+	if (capacity < mixer->period)
+		capacity = mixer->period;
+
+	int16_t *ring = malloc(capacity * mixer->channels * sizeof(int16_t));
+	if (!ring) {
+		mixer_leave(mixer);
+		return -ENOMEM;
+	}
+
+	free(self->ring);
+	self->ring = ring;
+	self->capacity = capacity;
+	self->read = 0;
+	self->fill = 0;
+	self->duck = GAIN_UNITY;
+	self->is_open = 1;
+
+	object->device_format = MIXER_FORMAT;
+	object->device_rate = mixer->rate;
+	object->device_channels = mixer->channels;
+	object->negotiated.period_us = 1000000 / MIXER_PERIODS_PER_SECOND;
+	object->negotiated.periods = (uint32_t)(capacity / mixer->period);
+	object->negotiated.latency_us = (uint32_t)((uint64_t)capacity * 1000000 / mixer->rate);
+	mixer_leave(mixer);
+	return 0;
+}
+
+static void
+mixer_stream_close(struct audio_object *object)
+{
+	struct mixer_stream *self = to_mixer_stream(object);
+	struct audio_mixer *mixer = mixer_enter(self);
+	if (!mixer)
+		return;
+
+	self->is_open = 0;
+	self->fill = 0;
+	pthread_cond_broadcast(&self->cond);
+	mixer_leave(mixer);
+}
+
+static void
+mixer_stream_destroy(struct audio_object *object)
+{
+	struct mixer_stream *self = to_mixer_stream(object);
+	struct audio_mixer *mixer = self->mixer;
+
+	pthread_mutex_lock(&mixer->mutex);
+	mixer_remove(mixer, self);
+	mixer_release(mixer);
+
+	pthread_cond_destroy(&self->cond);
+	free(self->ring);
+	free(self);
+}
+
+static int
+mixer_stream_write(struct audio_object *object,
+                   const void *data,
+                   size_t bytes)
+{
+	struct mixer_stream *self = to_mixer_stream(object);
+	struct audio_mixer *mixer = mixer_enter(self);
+	if (!mixer)
+		return -ENODEV;
+
+	const int16_t *in = data;
+	size_t frames = bytes / (mixer->channels * sizeof(int16_t));
+	int error = 0;
+
+	while (frames > 0 && self->is_open) {
+		if (self->fill == self->capacity) {
+			if (audio_write_cancelled(object)) {
+				error = -ECANCELED;
+				break;
+			}
+			pthread_cond_wait(&self->cond, &mixer->mutex);
+			if (mixer->detached) {
+				error = -ENODEV;
+				break;
+			}
+			continue;
+		}
+
+		size_t write = (self->read + self->fill) % self->capacity;
+		size_t n = self->capacity - self->fill;
+		if (n > self->capacity - write)
+			n = self->capacity - write;
+		if (n > frames)
+			n = frames;
+		memcpy(self->ring + write * mixer->channels, in, n * mixer->channels * sizeof(int16_t));
+		self->fill += n;
+		in += n * mixer->channels;
+		frames -= n;
+		pthread_cond_signal(&mixer->cond);
+	}
+	if (error == 0)
+		error = mixer->error;
+	mixer_leave(mixer);
+	return error;
+}
+
+static int
+mixer_stream_drain(struct audio_object *object)
+{
+	struct mixer_stream *self = to_mixer_stream(object);
+	struct audio_mixer *mixer = mixer_enter(self);
+	if (!mixer)
+		return -ENODEV;
+
+	while (!mixer->detached && self->is_open && (self->fill || self->mixing))
+		pthread_cond_wait(&self->cond, &mixer->mutex);
+	if (mixer->detached) {
+		mixer_leave(mixer);
+		return -ENODEV;
+	}
+	pthread_mutex_unlock(&mixer->mutex);
+
+	// Wait for the device to play the last of the audio. The device is not
+	// drained, as the other streams are still using it.
+	size_t delay = 0;
+	if (audio_object_get_delay(mixer->device, &delay) == 0 && delay) {
+		struct timespec ts;
+		uint64_t ns = (uint64_t)delay * 1000000000 / mixer->rate;
+		ts.tv_sec = ns / 1000000000;
+		ts.tv_nsec = ns % 1000000000;
+		nanosleep(&ts, NULL);
+	}
+
+	pthread_mutex_lock(&mixer->mutex);
+	mixer_leave(mixer);
+	return 0;
+}
+
+static int
+mixer_stream_drain_until(struct audio_object *object,
+                         uint64_t deadline,
+                         uint64_t generation)
+{
+	struct mixer_stream *self = to_mixer_stream(object);
+	struct audio_mixer *mixer = mixer_enter(self);
+	if (!mixer)
+		return -ENODEV;
+
+	int error = 0;
+	while (self->is_open && (self->fill || self->mixing)) {
+		if (mixer->detached) {
+			error = -ENODEV;
+			break;
+		}
+		if (audio_counter_get(&object->drain_generation) != generation) {
+			error = -ECANCELED;
+			break;
+		}
+		if (deadline == UINT64_MAX)
+			pthread_cond_wait(&self->cond, &mixer->mutex);
+		else if (audio_drain_remaining(deadline) == 0) {
+			error = -ETIMEDOUT;
+			break;
+		} else {
+			struct timespec ts;
+			audio_drain_abstime(deadline, &ts);
+			pthread_cond_timedwait(&self->cond, &mixer->mutex, &ts);
+		}
+	}
+	if (error != 0) {
+		mixer_leave(mixer);
+		return error;
+	}
+	pthread_mutex_unlock(&mixer->mutex);
+
+	// Wait for the device to play the last of the audio. The device is not
+	// drained, as the other streams are still using it.
+	size_t delay = 0;
+	if (audio_object_get_delay(mixer->device, &delay) == 0 && delay != 0) {
+		uint32_t ms = (uint64_t)delay * 1000 / mixer->rate;
+		int remaining = audio_drain_remaining(deadline);
+		if (remaining >= 0 && (uint32_t)remaining < ms) {
+			error = audio_drain_sleep(object, generation, remaining);
+			if (error == 0)
+				error = -ETIMEDOUT;
+		} else
+			error = audio_drain_sleep(object, generation, ms);
+	}
+
+	pthread_mutex_lock(&mixer->mutex);
+	mixer_leave(mixer);
+	return error;
+}
+
+static void
+mixer_stream_wake(struct audio_object *object)
+{
+	struct mixer_stream *self = to_mixer_stream(object);
+	struct audio_mixer *mixer = mixer_enter(self);
+	if (!mixer)
+		return;
+
+	pthread_cond_broadcast(&self->cond);
+	mixer_leave(mixer);
+}
+
+static int
+mixer_stream_flush(struct audio_object *object)
+{
+	struct mixer_stream *self = to_mixer_stream(object);
+	struct audio_mixer *mixer = mixer_enter(self);
+	if (!mixer)
+		return -ENODEV;
+
+	self->fill = 0;
+	pthread_cond_broadcast(&self->cond);
+	mixer_leave(mixer);
+	return 0;
+}
+
+static int
+mixer_stream_delay(struct audio_object *object,
+                   size_t *frames)
+{
+	struct mixer_stream *self = to_mixer_stream(object);
+	struct audio_mixer *mixer = mixer_enter(self);
+	if (!mixer)
+		return -ENODEV;
+	pthread_mutex_unlock(&mixer->mutex);
+
+	size_t delay = 0;
+	audio_object_get_delay(mixer->device, &delay);
+
+	pthread_mutex_lock(&mixer->mutex);
+	*frames = self->fill + self->mixing + delay;
+	mixer_leave(mixer);
+	return 0;
+}
+
+static int
+mixer_stream_set_gain(struct audio_object *object,
+                      float gain)
+{
+	struct mixer_stream *self = to_mixer_stream(object);
+	struct audio_mixer *mixer = mixer_enter(self);
+	if (!mixer)
+		return -ENODEV;
+
+	self->gain = (int32_t)(gain * GAIN_UNITY + 0.5f);
+	mixer_leave(mixer);
+	return 0;
+}
+
+static const char *
+mixer_stream_strerror(struct audio_object *object,
+                      int error)
+{
+	return strerror(error < 0 ? -error : error);
+}
+
+struct audio_object *
+audio_mixer_create_stream(struct audio_mixer *mixer)
+{
+	if (!mixer)
+		return NULL;
+
+	struct mixer_stream *self = calloc(1, sizeof(struct mixer_stream));
+	if (!self)
+		return NULL;
+
+	self->mixer = mixer;
+	self->gain = GAIN_UNITY;
+	self->duck = GAIN_UNITY;
+	self->priority = 0;
+	self->mode = AUDIO_MIXER_PREEMPT;
+	pthread_cond_init(&self->cond, NULL);
+
+	self->vtable.open = mixer_stream_open;
+	self->vtable.close = mixer_stream_close;
+	self->vtable.destroy = mixer_stream_destroy;
+	self->vtable.write = mixer_stream_write;
+	self->vtable.drain = mixer_stream_drain;
+	self->vtable.flush = mixer_stream_flush;
+	self->vtable.strerror = mixer_stream_strerror;
+	self->vtable.delay = mixer_stream_delay;
+	self->vtable.set_gain = mixer_stream_set_gain;
+	self->vtable.drain_until = mixer_stream_drain_until;
+	self->vtable.wake = mixer_stream_wake;
+	self->vtable.backend = "mixer";
+
+	pthread_mutex_lock(&mixer->mutex);
+	++mixer->refs;
+	mixer_insert(mixer, self);
+	pthread_mutex_unlock(&mixer->mutex);
+	return &self->vtable;
+}
+
+int
+audio_mixer_set_priority(struct audio_object *stream,
+                         int priority,
+                         enum audio_mixer_priority_mode mode)
+{
+	if (!stream || stream->open != mixer_stream_open)
+		return -EINVAL;
+	if (mode != AUDIO_MIXER_PREEMPT && mode != AUDIO_MIXER_DUCK)
+		return -EINVAL;
+
+	struct mixer_stream *self = to_mixer_stream(stream);
+	struct audio_mixer *mixer = mixer_enter(self);
+	if (!mixer)
+		return -ENODEV;
+
+	mixer_remove(mixer, self);
+	self->priority = priority;
+	self->mode = mode;
+	mixer_insert(mixer, self);
+	mixer_leave(mixer);
+	return 0;
+}
+
+int
+audio_mixer_set_ducking(struct audio_mixer *mixer,
+                        float gain,
+                        uint32_t ramp_ms)
+{
+	if (!mixer || gain < 0.0f || gain > 1.0f)
+		return -EINVAL;
+
+	pthread_mutex_lock(&mixer->mutex);
+	mixer->duck_gain = (int32_t)(gain * GAIN_UNITY + 0.5f);
+	mixer_set_duck_ramp(mixer, ramp_ms);
+	pthread_mutex_unlock(&mixer->mutex);
+	return 0;
+}
+
+#else
+
+struct audio_mixer *
+audio_mixer_create(struct audio_object *device,
+                   uint32_t rate,
+                   uint8_t channels)
+{
+	return NULL;
+}
+
+void
+audio_mixer_destroy(struct audio_mixer *mixer)
+{
+}
+
+struct audio_object *
+audio_mixer_create_stream(struct audio_mixer *mixer)
+{
+	return NULL;
+}
+
+int
+audio_mixer_set_priority(struct audio_object *stream,
+                         int priority,
+                         enum audio_mixer_priority_mode mode)
+{
+	return -ENOSYS;
+}
+
+int
+audio_mixer_set_ducking(struct audio_mixer *mixer,
+                        float gain,
+                        uint32_t ramp_ms)
+{
+	return -ENOSYS;
+}
+
+#endif
@@ -0,0 +1,386 @@
+/* Null Output.
+ *
+ * Copyright (C) 2026 Reece H. Dunn
+ *
+ * This file is part of pcaudiolib.
+ *
+ * pcaudiolib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pcaudiolib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pcaudiolib.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "audio_priv.h"
+
+#if defined(HAVE_PTHREAD_H)
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef HAVE_SYS_TIMERFD_H
+#include <poll.h>
+#include <sys/timerfd.h>
+#endif
+
+/* The null device discards the audio. By default it plays it at the
+ * real-time rate -- a write blocks while the buffer is full, and the delay
+ * counts down as the audio "plays" -- so it behaves like a sound card. The
+ * "unlimited" device consumes the audio as soon as it is written.
+ */
+struct null_object
+{
+	struct audio_object vtable;
+	int unlimited;
+	int is_open;
+	uint32_t rate;
+	size_t frame_size;
+	uint64_t capacity;   // frames
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;  // signalled by wake, to cancel a write
+	int running;
+	struct timespec start;
+	uint64_t written;    // frames since start
+
+	int timer;           // readable when there is space, for get_pollfds
+};
+
+#define to_null_object(object) container_of(object, struct null_object, vtable)
+
+static uint64_t
+elapsed_ns(const struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)(now.tv_sec - start->tv_sec) * 1000000000 + now.tv_nsec - start->tv_nsec;
+}
+
+static void
+sleep_ns(uint64_t ns)
+{
+	struct timespec ts;
+	ts.tv_sec = ns / 1000000000;
+	ts.tv_nsec = ns % 1000000000;
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+		;
+}
+
+/* The number of frames written but not yet played. Must be called with the
+ * mutex held. */
+static uint64_t
+null_queued(struct null_object *self)
+{
+	if (!self->running)
+		return 0;
+
+	uint64_t played = elapsed_ns(&self->start) * self->rate / 1000000000;
+	if (played >= self->written) {
+		// The device ran out of audio and stopped.
+		self->running = 0;
+		self->written = 0;
+		return 0;
+	}
+	return self->written - played;
+}
+
+/* The number of frames that can be written without blocking. Must be called
+ * with the mutex held. */
+static uint64_t
+null_space(struct null_object *self)
+{
+	uint64_t queued = null_queued(self);
+	return queued < self->capacity ? self->capacity - queued : 0;
+}
+
+/* Make the timer readable when there is space to write, as a device is.
+ * Must be called with the mutex held. */
+static void
+null_arm_timer(struct null_object *self)
+{
+#ifdef HAVE_SYS_TIMERFD_H
+	if (self->timer == -1)
+		return;
+
+	struct itimerspec its;
+	memset(&its, 0, sizeof(its));
+	if (self->is_open) {
+		uint64_t ns = 1;
+		if (!self->unlimited && null_space(self) == 0) {
+			// Wake when a quarter of the buffer has been played, as write does.
+			uint64_t queued = null_queued(self);
+			ns = (queued - self->capacity + (self->capacity + 3) / 4) * 1000000000 / self->rate;
+		}
+		its.it_value.tv_sec = ns / 1000000000;
+		its.it_value.tv_nsec = ns % 1000000000;
+	}
+	timerfd_settime(self->timer, 0, &its, NULL);
+#endif
+}
+
+int
+null_object_open(struct audio_object *object,
+                 enum audio_object_format format,
+                 uint32_t rate,
+                 uint8_t channels)
+{
+	struct null_object *self = to_null_object(object);
+	if (self->is_open)
+		return -EEXIST;
+	if (rate == 0 || channels == 0)
+		return -EINVAL;
+
+	uint32_t latency_us = object->buffering.latency_us;
+	if (!latency_us && object->buffering.period_us)
+		latency_us = object->buffering.period_us * (object->buffering.periods ? object->buffering.periods : 2);
+	if (!latency_us)
+		latency_us = DEFAULT_LATENCY_US;
+
+	self->rate = rate;
+	self->frame_size = audio_object_format_size(format) * channels;
+	self->capacity = (uint64_t)rate * latency_us / 1000000;
+	if (self->capacity == 0)
+		self->capacity = 1;
+	self->running = 0;
+	self->written = 0;
+	self->is_open = 1;
+
+	object->negotiated.latency_us = latency_us;
+	object->negotiated.periods = object->buffering.periods ? object->buffering.periods : 2;
+	object->negotiated.period_us = latency_us / object->negotiated.periods;
+	return 0;
+}
+
+void
+null_object_close(struct audio_object *object)
+{
+	struct null_object *self = to_null_object(object);
+
+	pthread_mutex_lock(&self->mutex);
+	self->is_open = 0;
+	self->running = 0;
+	self->written = 0;
+	null_arm_timer(self);
+	pthread_mutex_unlock(&self->mutex);
+}
+
+void
+null_object_destroy(struct audio_object *object)
+{
+	struct null_object *self = to_null_object(object);
+
+	if (self->timer != -1)
+		close(self->timer);
+	pthread_cond_destroy(&self->cond);
+	pthread_mutex_destroy(&self->mutex);
+	free(self);
+}
+
+int
+null_object_write(struct audio_object *object,
+                  const void *data,
+                  size_t bytes)
+{
+	struct null_object *self = to_null_object(object);
+	if (!self->is_open)
+		return -EBADF;
+	if (self->unlimited)
+		return 0;
+
+	uint64_t frames = bytes / self->frame_size;
+	int error = 0;
+	pthread_mutex_lock(&self->mutex);
+	while (frames > 0) {
+		uint64_t queued = null_queued(self);
+		if (queued >= self->capacity) {
+			if (audio_write_cancelled(object)) {
+				error = -ECANCELED;
+				break;
+			}
+			// Wait until there is room for a quarter of the buffer, so the
+			// writer is woken about as often as a real device would.
+			uint64_t wait = queued - self->capacity + (self->capacity + 3) / 4;
+			struct timespec ts;
+			audio_drain_abstime(audio_drain_deadline((int)(wait * 1000 / self->rate + 1)), &ts);
+			pthread_cond_timedwait(&self->cond, &self->mutex, &ts);
+			continue;
+		}
+
+		uint64_t count = self->capacity - queued;
+		if (count > frames)
+			count = frames;
+		if (!self->running) {
+			clock_gettime(CLOCK_MONOTONIC, &self->start);
+			self->running = 1;
+		}
+		self->written += count;
+		frames -= count;
+	}
+	null_arm_timer(self);
+	pthread_mutex_unlock(&self->mutex);
+	return error;
+}
+
+int
+null_object_drain(struct audio_object *object)
+{
+	struct null_object *self = to_null_object(object);
+
+	pthread_mutex_lock(&self->mutex);
+	uint64_t queued = null_queued(self);
+	pthread_mutex_unlock(&self->mutex);
+
+	if (queued)
+		sleep_ns(queued * 1000000000 / self->rate);
+	return 0;
+}
+
+void
+null_object_wake(struct audio_object *object)
+{
+	struct null_object *self = to_null_object(object);
+
+	pthread_mutex_lock(&self->mutex);
+	pthread_cond_broadcast(&self->cond);
+	pthread_mutex_unlock(&self->mutex);
+}
+
+int
+null_object_flush(struct audio_object *object)
+{
+	struct null_object *self = to_null_object(object);
+
+	pthread_mutex_lock(&self->mutex);
+	self->running = 0;
+	self->written = 0;
+	null_arm_timer(self);
+	pthread_mutex_unlock(&self->mutex);
+	return 0;
+}
+
+int
+null_object_delay(struct audio_object *object,
+                  size_t *frames)
+{
+	struct null_object *self = to_null_object(object);
+
+	pthread_mutex_lock(&self->mutex);
+	*frames = (size_t)null_queued(self);
+	pthread_mutex_unlock(&self->mutex);
+	return 0;
+}
+
+#ifdef HAVE_SYS_TIMERFD_H
+
+int
+null_object_get_pollfds(struct audio_object *object,
+                        struct audio_object_pollfd *fds,
+                        unsigned int space)
+{
+	struct null_object *self = to_null_object(object);
+	if (!self->is_open)
+		return -EBADF;
+
+	pthread_mutex_lock(&self->mutex);
+	if (self->timer == -1) {
+		self->timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		null_arm_timer(self);
+	}
+	pthread_mutex_unlock(&self->mutex);
+	if (self->timer == -1)
+		return -errno;
+
+	if (space > 0) {
+		fds[0].fd = self->timer;
+		fds[0].events = POLLIN;
+		fds[0].revents = 0;
+	}
+	return 1;
+}
+
+int
+null_object_service(struct audio_object *object,
+                    const struct audio_object_pollfd *fds,
+                    unsigned int nfds,
+                    size_t *frames)
+{
+	struct null_object *self = to_null_object(object);
+	uint64_t expirations;
+
+	*frames = 0;
+	if (!self->is_open)
+		return -EBADF;
+
+	pthread_mutex_lock(&self->mutex);
+	if (self->timer != -1 && read(self->timer, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN) {
+		pthread_mutex_unlock(&self->mutex);
+		return -errno;
+	}
+	*frames = self->unlimited ? self->capacity : null_space(self);
+	null_arm_timer(self);
+	pthread_mutex_unlock(&self->mutex);
+	return 0;
+}
+
+#endif
+
+const char *
+null_object_strerror(struct audio_object *object,
+                     int error)
+{
+	return strerror(error < 0 ? -error : error);
+}
+
+struct audio_object *
+create_null_object(const char *device,
+                   const char *application_name,
+                   const char *description)
+{
+	struct null_object *self = calloc(1, sizeof(struct null_object));
+	if (!self)
+		return NULL;
+
+	self->unlimited = device && !strcmp(device, "unlimited");
+	pthread_mutex_init(&self->mutex, NULL);
+	pthread_cond_init(&self->cond, NULL);
+	self->timer = -1;
+
+	self->vtable.open = null_object_open;
+	self->vtable.close = null_object_close;
+	self->vtable.destroy = null_object_destroy;
+	self->vtable.write = null_object_write;
+	self->vtable.drain = null_object_drain;
+	self->vtable.flush = null_object_flush;
+	self->vtable.strerror = null_object_strerror;
+	self->vtable.delay = null_object_delay;
+	self->vtable.wake = null_object_wake;
+#ifdef HAVE_SYS_TIMERFD_H
+	self->vtable.get_pollfds = null_object_get_pollfds;
+	self->vtable.service = null_object_service;
+#endif
+
+	return &self->vtable;
+}
+
+#else
+
+struct audio_object *
+create_null_object(const char *device,
+                   const char *application_name,
+                   const char *description)
+{
+	return NULL;
+}
+
+#endif
@@ -26,6 +26,7 @@
 #include <sys/soundcard.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <string.h>
 #include <stdio.h>
 #include <sys/ioctl.h>
@@ -42,6 +43,44 @@ struct oss_object
 
 #define to_oss_object(object) container_of(object, struct oss_object, vtable)
 
+static const enum audio_object_format oss_formats[] =
+{
+	AUDIO_OBJECT_FORMAT_S8,
+	AUDIO_OBJECT_FORMAT_U8,
+	AUDIO_OBJECT_FORMAT_S16LE,
+	AUDIO_OBJECT_FORMAT_S16BE,
+	AUDIO_OBJECT_FORMAT_U16LE,
+	AUDIO_OBJECT_FORMAT_U16BE,
+};
+
+// Get the SNDCTL_DSP_SETFRAGMENT value for the requested buffering, or 0 to
+// use the driver defaults.
+static int
+oss_fragment(const struct audio_buffering *buffering,
+             uint32_t bytes_per_second)
+{
+	if (!buffering->period_us && !buffering->periods && !buffering->latency_us)
+		return 0;
+
+	uint32_t period = buffering->period_us;
+	if (!period)
+		period = buffering->latency_us ? buffering->latency_us / (buffering->periods ? buffering->periods : 2) : DEFAULT_LATENCY_US;
+
+	uint32_t fragments = buffering->periods;
+	if (!fragments)
+		fragments = buffering->latency_us ? buffering->latency_us / period : 0x7FFF;
+	if (fragments < 2)
+		fragments = 2;
+
+	// The fragment size is a power of two, from 16 bytes.
+	uint64_t bytes = (uint64_t)bytes_per_second * period / 1000000;
+	int selector = 4;
+	while (selector < 24 && ((uint64_t)1 << selector) < bytes)
+		++selector;
+
+	return (fragments << 16) | selector;
+}
+
 int
 oss_object_open(struct audio_object *object,
                 enum audio_object_format format,
@@ -53,6 +92,8 @@ oss_object_open(struct audio_object *object,
 		return EEXIST;
 
 	int oss_format;
+	format = audio_convert_nearest(format, oss_formats, sizeof(oss_formats) / sizeof(oss_formats[0]));
+	object->device_format = format;
 	switch (format)
 	{
 	case AUDIO_OBJECT_FORMAT_ALAW:  oss_format = AFMT_A_LAW;     break;
@@ -72,17 +113,29 @@ oss_object_open(struct audio_object *object,
 	}
 
 	int data;
+	uint32_t bytes_per_second = audio_object_format_size(format) * channels * rate;
 	if ((self->fd = open(self->device ? self->device : DEFAULT_OSS_DEVICE, O_RDWR, 0)) == -1)
 		return errno;
+	if ((data = oss_fragment(&object->buffering, bytes_per_second)) != 0 &&
+	    ioctl(self->fd, SNDCTL_DSP_SETFRAGMENT, &data) == -1)
+		goto error;
 	if (ioctl(self->fd, SNDCTL_DSP_SETFMT, &oss_format) == -1)
 		goto error;
 	data = rate;
 	if (ioctl(self->fd, SNDCTL_DSP_SPEED, &data) == -1)
 		goto error;
+	object->device_rate = data;
 	data = channels;
 	if (ioctl(self->fd, SNDCTL_DSP_CHANNELS, &data) == -1)
 		goto error;
+	object->device_channels = data;
 
+	audio_buf_info info;
+	if (bytes_per_second && ioctl(self->fd, SNDCTL_DSP_GETOSPACE, &info) != -1) {
+		object->negotiated.period_us = (uint64_t)info.fragsize * 1000000 / bytes_per_second;
+		object->negotiated.periods = info.fragstotal;
+		object->negotiated.latency_us = object->negotiated.period_us * info.fragstotal;
+	}
 	return 0;
 error:
 	data = errno;
@@ -138,8 +191,72 @@ oss_object_write(struct audio_object *object,
 {
 	struct oss_object *self = to_oss_object(object);
 
-	if (write(self->fd, data, bytes) == -1)
+	while (bytes > 0) {
+		ssize_t written = write(self->fd, data, bytes);
+		if (written == -1)
+			return errno;
+		if ((size_t)written < bytes) {
+			// Interrupted by a signal after writing some of the audio.
+			audio_counter_add(&object->stats.short_writes, 1);
+		}
+		data = (const char *)data + written;
+		bytes -= written;
+	}
+	return 0;
+}
+
+int
+oss_object_delay(struct audio_object *object,
+                 size_t *frames)
+{
+	struct oss_object *self = to_oss_object(object);
+	int bytes = 0;
+
+	*frames = 0;
+	if (self->fd == -1)
+		return 0;
+	if (ioctl(self->fd, SNDCTL_DSP_GETODELAY, &bytes) == -1)
 		return errno;
+	size_t frame_size = audio_object_format_size(object->device_format) * object->device_channels;
+	if (frame_size)
+		*frames = bytes / frame_size;
+	return 0;
+}
+
+int
+oss_object_get_pollfds(struct audio_object *object,
+                       struct audio_object_pollfd *fds,
+                       unsigned int space)
+{
+	struct oss_object *self = to_oss_object(object);
+	if (self->fd == -1)
+		return -EBADF;
+
+	if (space > 0) {
+		fds[0].fd = self->fd;
+		fds[0].events = POLLOUT;
+		fds[0].revents = 0;
+	}
+	return 1;
+}
+
+int
+oss_object_service(struct audio_object *object,
+                   const struct audio_object_pollfd *fds,
+                   unsigned int nfds,
+                   size_t *frames)
+{
+	struct oss_object *self = to_oss_object(object);
+	audio_buf_info info;
+
+	*frames = 0;
+	if (self->fd == -1)
+		return -EBADF;
+	if (ioctl(self->fd, SNDCTL_DSP_GETOSPACE, &info) == -1)
+		return -errno;
+	size_t frame_size = audio_object_format_size(object->device_format) * object->device_channels;
+	if (frame_size && info.bytes > 0)
+		*frames = info.bytes / frame_size;
 	return 0;
 }
 
@@ -147,7 +264,7 @@ const char *
 oss_object_strerror(struct audio_object *object,
                     int error)
 {
-	return strerror(error);
+	return strerror(error < 0 ? -error : error);
 }
 
 struct audio_object *
@@ -155,7 +272,7 @@ create_oss_object(const char *device,
                   const char *application_name,
                   const char *description)
 {
-	struct oss_object *self = malloc(sizeof(struct oss_object));
+	struct oss_object *self = calloc(1, sizeof(struct oss_object));
 	if (!self)
 		return NULL;
 
@@ -169,6 +286,9 @@ create_oss_object(const char *device,
 	self->vtable.drain = oss_object_drain;
 	self->vtable.flush = oss_object_flush;
 	self->vtable.strerror = oss_object_strerror;
+	self->vtable.delay = oss_object_delay;
+	self->vtable.get_pollfds = oss_object_get_pollfds;
+	self->vtable.service = oss_object_service;
 
 	return &self->vtable;
 }
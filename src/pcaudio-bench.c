@@ -0,0 +1,645 @@
+/* Audio Benchmarks.
+ *
+ * Copyright (C) 2026 Reece H. Dunn
+ *
+ * This file is part of pcaudiolib.
+ *
+ * pcaudiolib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pcaudiolib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pcaudiolib.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <pcaudiolib/audio.h>
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_STDATOMIC_H)
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#endif
+
+/* Run against the null backend, the ALSA null PCM and the default PipeWire and
+ * PulseAudio sinks (which can be null sinks, see README.md) unless targets are
+ * given. */
+static const char *default_targets[] =
+{
+	"null:unlimited",
+	"null",
+	"alsa:null",
+	"pipewire",
+	"pulseaudio",
+	NULL,
+};
+
+/* Flushes are timed this many times. */
+#define FLUSH_RUNS 20
+
+/* Give up waiting for the first sample to play after this long. */
+#define FIRST_SAMPLE_TIMEOUT_US 2000000
+
+struct options
+{
+	enum audio_object_format format;
+	const char *format_name;
+	uint32_t rate;
+	uint8_t channels;
+	double seconds;
+	uint32_t chunk_ms;
+	enum audio_object_resample_quality quality;
+	uint32_t start_us;
+	size_t stress;
+};
+
+struct format_name
+{
+	const char *name;
+	enum audio_object_format format;
+	size_t size;
+};
+
+static const struct format_name formats[] =
+{
+	{ "u8",        AUDIO_OBJECT_FORMAT_U8,        1 },
+	{ "s16le",     AUDIO_OBJECT_FORMAT_S16LE,     2 },
+	{ "s16be",     AUDIO_OBJECT_FORMAT_S16BE,     2 },
+	{ "s24le",     AUDIO_OBJECT_FORMAT_S24LE,     3 },
+	{ "s32le",     AUDIO_OBJECT_FORMAT_S32LE,     4 },
+	{ "float32le", AUDIO_OBJECT_FORMAT_FLOAT32LE, 4 },
+	{ NULL, 0, 0 },
+};
+
+static const struct format_name *
+find_format(const char *name)
+{
+	const struct format_name *format;
+	for (format = formats; format->name; ++format)
+		if (!strcmp(format->name, name))
+			return format;
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Measurements                                                              */
+
+static double
+now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static double
+cpu_us(void)
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e6 +
+	       usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static int
+compare_double(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static void
+print_percentiles(const char *name, double *samples, size_t count)
+{
+	if (count == 0) {
+		printf("\"%s\": null", name);
+		return;
+	}
+
+	qsort(samples, count, sizeof(double), compare_double);
+	printf("\"%s\": {\"count\": %zu, \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"max\": %.1f}",
+	       name, count,
+	       samples[count * 50 / 100],
+	       samples[count * 90 / 100],
+	       samples[count * 99 / 100],
+	       samples[count - 1]);
+}
+
+static void
+print_number(const char *name, double value)
+{
+	if (value < 0)
+		printf("\"%s\": null", name);
+	else
+		printf("\"%s\": %.1f", name, value);
+}
+
+static void
+print_string(const char *name, const char *value)
+{
+	printf("\"%s\": ", name);
+	if (!value) {
+		printf("null");
+		return;
+	}
+	putchar('"');
+	for (; *value; ++value) {
+		if (*value == '"' || *value == '\\')
+			putchar('\\');
+		if ((unsigned char)*value >= 0x20)
+			putchar(*value);
+	}
+	putchar('"');
+}
+
+/* ------------------------------------------------------------------------- */
+/* Benchmarks                                                                */
+
+static void *
+make_signal(const struct options *options, const struct format_name *format, size_t frames)
+{
+	size_t samples = frames * options->channels;
+	unsigned char *data = malloc(samples * format->size);
+	if (!data)
+		return NULL;
+
+	for (size_t i = 0; i < samples; ++i) {
+		double x = 0.5 * sin(2 * M_PI * 440.0 * (i / options->channels) / options->rate);
+		int32_t s = (int32_t)(x * 2147483647.0);
+		unsigned char *out = data + i * format->size;
+		switch (format->format)
+		{
+		case AUDIO_OBJECT_FORMAT_U8:
+			out[0] = (unsigned char)((s >> 24) + 128);
+			break;
+		case AUDIO_OBJECT_FORMAT_S16BE:
+			out[0] = s >> 24;
+			out[1] = s >> 16;
+			break;
+		case AUDIO_OBJECT_FORMAT_FLOAT32LE: {
+			float f = (float)x;
+			memcpy(out, &f, sizeof(f));
+			break;
+		}
+		default: // little endian, most significant bytes of s
+			for (size_t b = 0; b < format->size; ++b)
+				out[b] = s >> (8 * (4 - format->size + b));
+			break;
+		}
+	}
+	return data;
+}
+
+/* Time from the first write to the position advancing, or -1 if the backend
+ * does not report it. A chunk is written every chunk_ms, as a synthesizer
+ * producing audio in real time would, so this measures when the start
+ * threshold is reached rather than how quickly the buffer can be filled. */
+static double
+time_to_first_sample(struct audio_object *object, const void *chunk, size_t bytes, uint32_t chunk_ms)
+{
+	double start = now_us();
+	double next = start;
+	uint64_t position = 0;
+	do {
+		if (now_us() >= next) {
+			if (audio_object_write(object, chunk, bytes) != 0)
+				return -1;
+			next += chunk_ms * 1000.0;
+		}
+		if (audio_object_get_position(object, &position) != 0)
+			return -1;
+		if (position > 0)
+			return now_us() - start;
+		usleep(100);
+	} while (now_us() - start < FIRST_SAMPLE_TIMEOUT_US);
+	return -1;
+}
+
+/* The start thresholds compared in the start_modes results. */
+static const struct
+{
+	const char *name;
+	uint32_t start_us;
+} start_modes[] =
+{
+	{ "default",   0 },
+	{ "immediate", AUDIO_OBJECT_START_IMMEDIATE },
+};
+
+/* The backends that use the start threshold (see audio_object_set_thresholds).
+ * The others start playing the same way in every start mode. */
+static int
+uses_start_threshold(const char *backend)
+{
+	return strcmp(backend, "alsa") == 0 || strcmp(backend, "pulseaudio") == 0;
+}
+
+/* Measure time_to_first_sample on a newly opened object, so each start mode
+ * starts from an empty buffer. */
+static double
+start_mode_first_sample(const char *backend, const char *device, const struct options *options,
+                        uint32_t start_us, const void *chunk, size_t bytes)
+{
+	struct audio_object *object = create_audio_device_object_ex(backend, device, "pcaudio-bench", "Benchmark");
+	if (!object)
+		return -1;
+
+	double first_sample_us = -1;
+	audio_object_set_resample_quality(object, options->quality);
+	audio_object_set_thresholds(object, start_us, 0, 0);
+	if (audio_object_open(object, options->format, options->rate, options->channels) == 0) {
+		first_sample_us = time_to_first_sample(object, chunk, bytes, options->chunk_ms);
+		audio_object_flush(object);
+		audio_object_close(object);
+	}
+	audio_object_destroy(object);
+	return first_sample_us;
+}
+
+/* Write chunks with audio_object_begin_write and audio_object_commit, which
+ * render straight into the device's buffer when the backend supports it and
+ * no conversion is needed. Returns the number of chunks written. */
+static size_t
+run_commit(struct audio_object *object, const void *chunk, size_t frames,
+           size_t frame_size, size_t chunks, double *latencies, int *error)
+{
+	size_t calls = 0;
+	for (size_t i = 0; i < chunks && *error == 0; ++i) {
+		const char *in = chunk;
+		size_t remaining = frames;
+		double t = now_us();
+		while (remaining > 0) {
+			void *data = NULL;
+			size_t count = remaining;
+			if ((*error = audio_object_begin_write(object, &data, &count)) != 0)
+				break;
+			if (count > remaining)
+				count = remaining;
+			memcpy(data, in, count * frame_size);
+			if ((*error = audio_object_commit(object, count)) != 0)
+				break;
+			in += count * frame_size;
+			remaining -= count;
+		}
+		if (*error == 0)
+			latencies[calls++] = now_us() - t;
+	}
+	return calls;
+}
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_STDATOMIC_H)
+
+/* A writer thread that keeps the device full, draining now and then, while
+ * the main thread flushes the object. */
+struct stress
+{
+	struct audio_object *object;
+	const void *chunk;
+	size_t bytes;
+	atomic_int stop;
+	size_t writes;
+	size_t cancelled;
+	size_t errors;
+	int error;      // the first error other than -ECANCELED or -ETIMEDOUT
+};
+
+static void *
+stress_writer(void *arg)
+{
+	struct stress *stress = arg;
+	while (!atomic_load(&stress->stop)) {
+		int error = audio_object_write(stress->object, stress->chunk, stress->bytes);
+		if (error == 0 && ++stress->writes % 16 == 0)
+			error = audio_object_drain_timeout(stress->object, 5);
+		if (error == -ECANCELED) {
+			// Let the flush finish, as a synthesizer waiting for more text
+			// would, rather than spinning on the writes it cancels.
+			++stress->cancelled;
+			sched_yield();
+		} else if (error != 0 && error != -ETIMEDOUT && error != -ENOSYS) {
+			if (stress->errors++ == 0)
+				stress->error = error;
+		}
+	}
+	return NULL;
+}
+
+/* Flush the object from this thread while another writes to it, at random
+ * points up to two chunks apart. Returns the first unexpected error. */
+static int
+run_stress(struct audio_object *object, const struct options *options,
+           const void *chunk, size_t bytes, double *latencies)
+{
+	struct stress stress;
+	memset(&stress, 0, sizeof(stress));
+	stress.object = object;
+	stress.chunk = chunk;
+	stress.bytes = bytes;
+	atomic_init(&stress.stop, 0);
+
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, stress_writer, &stress) != 0) {
+		print_string("stress", "pthread_create failed");
+		return -EAGAIN;
+	}
+
+	size_t flushes = 0;
+	int error = 0;
+	srand(1);
+	for (size_t i = 0; i < options->stress; ++i) {
+		usleep((useconds_t)(rand() % (options->chunk_ms * 2000 + 1)));
+		double start = now_us();
+		if ((error = audio_object_flush(object)) != 0)
+			break;
+		latencies[flushes++] = now_us() - start;
+	}
+	atomic_store(&stress.stop, 1);
+	audio_object_flush(object);
+	pthread_join(thread, NULL);
+
+	if (error == 0)
+		error = stress.error;
+	printf("\"stress\": {\"writes\": %zu, \"cancelled\": %zu, \"errors\": %zu, ",
+	       stress.writes, stress.cancelled, stress.errors);
+	print_percentiles("flush_us", latencies, flushes);
+	printf("}");
+	return error;
+}
+
+#else
+
+static int
+run_stress(struct audio_object *object, const struct options *options,
+           const void *chunk, size_t bytes, double *latencies)
+{
+	print_string("stress", "not supported");
+	return 0;
+}
+
+#endif
+
+static int
+run_target(const char *target, const struct options *options, int first)
+{
+	const struct format_name *format = find_format(options->format_name);
+	char *backend = strdup(target);
+	char *device = strchr(backend, ':');
+	if (device)
+		*device++ = '\0';
+
+	printf("%s\n    {", first ? "" : ",");
+	print_string("target", target);
+	printf(", ");
+	print_string("backend", backend);
+	printf(", ");
+	print_string("device", device);
+
+	struct audio_object *object = create_audio_device_object_ex(backend, device, "pcaudio-bench", "Benchmark");
+	if (!object) {
+		printf(", \"ok\": false, ");
+		print_string("error", "backend not available");
+		printf("}");
+		free(backend);
+		return -1;
+	}
+	audio_object_set_resample_quality(object, options->quality);
+	audio_object_set_thresholds(object, options->start_us, 0, 0);
+
+	size_t chunk_frames = (size_t)options->rate * options->chunk_ms / 1000;
+	size_t chunk_bytes = chunk_frames * options->channels * format->size;
+	size_t chunks = (size_t)(options->seconds * 1000 / options->chunk_ms);
+	void *chunk = make_signal(options, format, chunk_frames);
+	size_t samples = chunks > FLUSH_RUNS ? chunks : FLUSH_RUNS;
+	double *latencies = calloc(samples > options->stress ? samples : options->stress, sizeof(double));
+
+	double start = now_us();
+	int error = audio_object_open(object, options->format, options->rate, options->channels);
+	double open_us = now_us() - start;
+	if (error != 0) {
+		printf(", \"ok\": false, ");
+		print_string("error", audio_object_strerror(object, error));
+		printf("}");
+		goto done;
+	}
+
+	enum audio_object_format device_format;
+	uint32_t device_rate = 0;
+	uint8_t device_channels = 0;
+	uint32_t period_us = 0, periods = 0, latency_us = 0;
+	audio_object_get_device_format(object, &device_format, &device_rate, &device_channels);
+	audio_object_get_buffering(object, &period_us, &periods, &latency_us);
+
+	// Start up.
+	double first_sample_us = time_to_first_sample(object, chunk, chunk_bytes, options->chunk_ms);
+
+	// Streaming writes.
+	double cpu_start = cpu_us();
+	double write_start = now_us();
+	size_t calls = 0;
+	for (size_t i = 0; i < chunks; ++i) {
+		double t = now_us();
+		if ((error = audio_object_write(object, chunk, chunk_bytes)) != 0)
+			break;
+		latencies[calls++] = now_us() - t;
+	}
+	double write_us = now_us() - write_start;
+
+	start = now_us();
+	audio_object_drain(object);
+	double drain_us = now_us() - start;
+	double cpu = cpu_us() - cpu_start;
+	double audio_seconds = (double)calls * chunk_frames / options->rate;
+
+	printf(", \"ok\": %s", error == 0 ? "true" : "false");
+	if (error != 0) {
+		printf(", ");
+		print_string("error", audio_object_strerror(object, error));
+	}
+	printf(",\n     \"negotiated\": {\"rate\": %u, \"channels\": %u, \"period_us\": %u, \"periods\": %u, \"latency_us\": %u},\n     ",
+	       device_rate, device_channels, period_us, periods, latency_us);
+	print_number("open_us", open_us);
+	printf(", ");
+	print_number("time_to_first_sample_us", first_sample_us);
+	printf(", ");
+	print_number("drain_us", drain_us);
+	printf(",\n     \"write\": {\"calls\": %zu, \"calls_per_sec\": %.1f, \"audio_seconds\": %.3f, \"wall_seconds\": %.3f, \"cpu_us_per_audio_second\": %.1f,\n       ",
+	       calls, write_us > 0 ? calls * 1e6 / write_us : 0.0, audio_seconds, write_us / 1e6,
+	       audio_seconds > 0 ? cpu / audio_seconds : 0.0);
+	print_percentiles("latency_us", latencies, calls);
+	printf("},\n     ");
+
+	// Flush (cancel) latency with a full buffer.
+	size_t flushes = 0;
+	for (int run = 0; run < FLUSH_RUNS && error == 0; ++run) {
+		for (int i = 0; i < 5 && error == 0; ++i)
+			error = audio_object_write(object, chunk, chunk_bytes);
+		start = now_us();
+		if (audio_object_flush(object) != 0)
+			break;
+		latencies[flushes++] = now_us() - start;
+	}
+	print_percentiles("flush_us", latencies, flushes);
+
+	// Zero-copy writes.
+	if (error == 0) {
+		calls = run_commit(object, chunk, chunk_frames, options->channels * format->size,
+		                   FLUSH_RUNS, latencies, &error);
+		audio_object_flush(object);
+		printf(",\n     \"commit\": {\"calls\": %zu, ", calls);
+		print_percentiles("latency_us", latencies, calls);
+		printf("}");
+	}
+
+	// Flushing from another thread while writing.
+	if (options->stress && error == 0) {
+		printf(",\n     ");
+		error = run_stress(object, options, chunk, chunk_bytes, latencies);
+	}
+
+	start = now_us();
+	audio_object_close(object);
+	printf(",\n     ");
+	print_number("close_us", now_us() - start);
+
+	// Start up with each start threshold.
+	if (uses_start_threshold(audio_object_get_backend(object))) {
+		printf(",\n     \"start_modes\": {");
+		for (size_t i = 0; i < sizeof(start_modes) / sizeof(start_modes[0]); ++i) {
+			printf("%s", i == 0 ? "" : ", ");
+			print_number(start_modes[i].name,
+			             start_mode_first_sample(backend, device, options, start_modes[i].start_us, chunk, chunk_bytes));
+		}
+		printf("}");
+	}
+	printf("}");
+
+done:
+	audio_object_destroy(object);
+	free(latencies);
+	free(chunk);
+	free(backend);
+	return error;
+}
+
+static void
+usage(FILE *out)
+{
+	fprintf(out, "Usage: pcaudio-bench [OPTION]... [BACKEND[:DEVICE]]...\n"
+	             "\n"
+	             "Benchmark the pcaudiolib write, drain and flush paths, printing the\n"
+	             "results as JSON. The default targets are:");
+	for (const char **target = default_targets; *target; ++target)
+		fprintf(out, " %s", *target);
+	fprintf(out, "\n"
+	             "\n"
+	             "  --format=FORMAT    u8, s16le (default), s16be, s24le, s32le or float32le\n"
+	             "  --rate=RATE        sample rate (default 22050)\n"
+	             "  --channels=N       number of channels (default 1)\n"
+	             "  --seconds=N        seconds of audio to write (default 2)\n"
+	             "  --chunk-ms=N       size of each write in milliseconds (default 20)\n"
+	             "  --quality=Q        resampler quality: none, fast, medium or best\n"
+	             "  --start=START      start threshold: default, immediate or microseconds\n"
+	             "  --stress=N         flush N times from another thread while writing\n"
+	             "  --help             show this help\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	struct options options;
+	options.format = AUDIO_OBJECT_FORMAT_S16LE;
+	options.format_name = "s16le";
+	options.rate = 22050;
+	options.channels = 1;
+	options.seconds = 2;
+	options.chunk_ms = 20;
+	options.quality = AUDIO_OBJECT_RESAMPLE_DEFAULT;
+	options.start_us = 0;
+	options.stress = 0;
+
+	size_t defaults = sizeof(default_targets) / sizeof(default_targets[0]);
+	const char **targets = calloc((size_t)argc + defaults, sizeof(char *));
+	int count = 0;
+	for (int i = 1; i < argc; ++i) {
+		const char *arg = argv[i];
+		if (!strncmp(arg, "--format=", 9)) {
+			const struct format_name *format = find_format(arg + 9);
+			if (!format) {
+				fprintf(stderr, "pcaudio-bench: unknown format '%s'\n", arg + 9);
+				return EXIT_FAILURE;
+			}
+			options.format = format->format;
+			options.format_name = format->name;
+		} else if (!strncmp(arg, "--rate=", 7))
+			options.rate = (uint32_t)atoi(arg + 7);
+		else if (!strncmp(arg, "--channels=", 11))
+			options.channels = (uint8_t)atoi(arg + 11);
+		else if (!strncmp(arg, "--seconds=", 10))
+			options.seconds = atof(arg + 10);
+		else if (!strncmp(arg, "--chunk-ms=", 11))
+			options.chunk_ms = (uint32_t)atoi(arg + 11);
+		else if (!strcmp(arg, "--quality=none"))
+			options.quality = AUDIO_OBJECT_RESAMPLE_NONE;
+		else if (!strcmp(arg, "--quality=fast"))
+			options.quality = AUDIO_OBJECT_RESAMPLE_FAST;
+		else if (!strcmp(arg, "--quality=medium"))
+			options.quality = AUDIO_OBJECT_RESAMPLE_MEDIUM;
+		else if (!strcmp(arg, "--quality=best"))
+			options.quality = AUDIO_OBJECT_RESAMPLE_BEST;
+		else if (!strcmp(arg, "--start=default"))
+			options.start_us = 0;
+		else if (!strcmp(arg, "--start=immediate"))
+			options.start_us = AUDIO_OBJECT_START_IMMEDIATE;
+		else if (!strncmp(arg, "--start=", 8))
+			options.start_us = (uint32_t)atoi(arg + 8);
+		else if (!strncmp(arg, "--stress=", 9))
+			options.stress = (size_t)atol(arg + 9);
+		else if (!strcmp(arg, "--help")) {
+			usage(stdout);
+			return EXIT_SUCCESS;
+		} else if (arg[0] == '-') {
+			usage(stderr);
+			return EXIT_FAILURE;
+		} else
+			targets[count++] = arg;
+	}
+	if (options.rate == 0 || options.channels == 0 || options.chunk_ms == 0 || options.seconds <= 0) {
+		usage(stderr);
+		return EXIT_FAILURE;
+	}
+	if (count == 0)
+		memcpy(targets, default_targets, sizeof(default_targets));
+
+	printf("{\n  ");
+	print_string("version", PACKAGE_VERSION);
+	printf(",\n  \"config\": {");
+	print_string("format", options.format_name);
+	printf(", \"rate\": %u, \"channels\": %u, \"seconds\": %.3f, \"chunk_ms\": %u},\n  \"results\": [",
+	       options.rate, options.channels, options.seconds, options.chunk_ms);
+
+	int failed = 0;
+	for (int i = 0; targets[i]; ++i)
+		if (run_target(targets[i], &options, i == 0) != 0)
+			++failed;
+	printf("\n  ]\n}\n");
+
+	free(targets);
+	return count > 0 && failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
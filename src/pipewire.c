@@ -0,0 +1,773 @@
+/* PipeWire Output.
+ *
+ * Copyright (C) 2026 Reece H. Dunn
+ *
+ * This file is part of pcaudiolib.
+ *
+ * pcaudiolib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pcaudiolib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pcaudiolib.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "audio_priv.h"
+
+#ifdef HAVE_PIPEWIRE_PIPEWIRE_H
+
+#include <pipewire/pipewire.h>
+#include <spa/param/audio/format-utils.h>
+#include <spa/utils/ringbuffer.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+/* The audio is written to a ring buffer that is read by the process callback
+ * on the PipeWire data thread. That callback runs in real time, so it does not
+ * take any locks or make any system calls other than signalling the refill
+ * event, which wakes the writers from the thread loop.
+ *
+ * The thread loop lock protects the stream, its state and the drained flag.
+ */
+struct pipewire_object
+{
+	struct audio_object vtable;
+	struct pw_thread_loop *loop;
+	struct pw_context *context;
+	struct pw_core *core;
+	struct pw_stream *stream;
+	struct spa_hook listener;
+	struct spa_source *refill;
+	enum pw_stream_state state;
+	int drained;
+	char *device;
+	char *application_name;
+	char *description;
+
+	uint32_t rate;
+	uint32_t frame_size;
+	uint8_t silence;
+
+	struct spa_ringbuffer ring;
+	uint8_t *buffer;
+	uint32_t size;       // bytes, a power of two
+	uint32_t capacity;   // bytes that can be queued, a whole number of frames
+	audio_counter flush_to; // the write index when the ring was flushed
+	audio_counter draining; // running out of audio is not an underrun
+	int playing;         // only used by the process callback
+
+	int wake[2];         // readable when there is space in the ring, for get_pollfds
+};
+
+#define to_pipewire_object(object) container_of(object, struct pipewire_object, vtable)
+
+/* The time to wait for the stream to be created by the server. */
+#define OPEN_TIMEOUT_MS 2000
+
+static const enum audio_object_format pipewire_formats[] =
+{
+	AUDIO_OBJECT_FORMAT_S8,
+	AUDIO_OBJECT_FORMAT_U8,
+	AUDIO_OBJECT_FORMAT_S16LE,
+	AUDIO_OBJECT_FORMAT_S16BE,
+	AUDIO_OBJECT_FORMAT_U16LE,
+	AUDIO_OBJECT_FORMAT_U16BE,
+	AUDIO_OBJECT_FORMAT_S24LE,
+	AUDIO_OBJECT_FORMAT_S24BE,
+	AUDIO_OBJECT_FORMAT_U24LE,
+	AUDIO_OBJECT_FORMAT_U24BE,
+	AUDIO_OBJECT_FORMAT_S24_32LE,
+	AUDIO_OBJECT_FORMAT_S24_32BE,
+	AUDIO_OBJECT_FORMAT_U24_32LE,
+	AUDIO_OBJECT_FORMAT_U24_32BE,
+	AUDIO_OBJECT_FORMAT_S32LE,
+	AUDIO_OBJECT_FORMAT_S32BE,
+	AUDIO_OBJECT_FORMAT_U32LE,
+	AUDIO_OBJECT_FORMAT_U32BE,
+	AUDIO_OBJECT_FORMAT_FLOAT32LE,
+	AUDIO_OBJECT_FORMAT_FLOAT32BE,
+	AUDIO_OBJECT_FORMAT_FLOAT64LE,
+	AUDIO_OBJECT_FORMAT_FLOAT64BE,
+	AUDIO_OBJECT_FORMAT_ALAW,
+	AUDIO_OBJECT_FORMAT_ULAW,
+};
+
+static enum spa_audio_format
+pipewire_sample_format(enum audio_object_format format)
+{
+	switch (format)
+	{
+	case AUDIO_OBJECT_FORMAT_S8:        return SPA_AUDIO_FORMAT_S8;
+	case AUDIO_OBJECT_FORMAT_U8:        return SPA_AUDIO_FORMAT_U8;
+	case AUDIO_OBJECT_FORMAT_S16LE:     return SPA_AUDIO_FORMAT_S16_LE;
+	case AUDIO_OBJECT_FORMAT_S16BE:     return SPA_AUDIO_FORMAT_S16_BE;
+	case AUDIO_OBJECT_FORMAT_U16LE:     return SPA_AUDIO_FORMAT_U16_LE;
+	case AUDIO_OBJECT_FORMAT_U16BE:     return SPA_AUDIO_FORMAT_U16_BE;
+	case AUDIO_OBJECT_FORMAT_S24LE:     return SPA_AUDIO_FORMAT_S24_LE;
+	case AUDIO_OBJECT_FORMAT_S24BE:     return SPA_AUDIO_FORMAT_S24_BE;
+	case AUDIO_OBJECT_FORMAT_U24LE:     return SPA_AUDIO_FORMAT_U24_LE;
+	case AUDIO_OBJECT_FORMAT_U24BE:     return SPA_AUDIO_FORMAT_U24_BE;
+	case AUDIO_OBJECT_FORMAT_S24_32LE:  return SPA_AUDIO_FORMAT_S24_32_LE;
+	case AUDIO_OBJECT_FORMAT_S24_32BE:  return SPA_AUDIO_FORMAT_S24_32_BE;
+	case AUDIO_OBJECT_FORMAT_U24_32LE:  return SPA_AUDIO_FORMAT_U24_32_LE;
+	case AUDIO_OBJECT_FORMAT_U24_32BE:  return SPA_AUDIO_FORMAT_U24_32_BE;
+	case AUDIO_OBJECT_FORMAT_S32LE:     return SPA_AUDIO_FORMAT_S32_LE;
+	case AUDIO_OBJECT_FORMAT_S32BE:     return SPA_AUDIO_FORMAT_S32_BE;
+	case AUDIO_OBJECT_FORMAT_U32LE:     return SPA_AUDIO_FORMAT_U32_LE;
+	case AUDIO_OBJECT_FORMAT_U32BE:     return SPA_AUDIO_FORMAT_U32_BE;
+	case AUDIO_OBJECT_FORMAT_FLOAT32LE: return SPA_AUDIO_FORMAT_F32_LE;
+	case AUDIO_OBJECT_FORMAT_FLOAT32BE: return SPA_AUDIO_FORMAT_F32_BE;
+	case AUDIO_OBJECT_FORMAT_FLOAT64LE: return SPA_AUDIO_FORMAT_F64_LE;
+	case AUDIO_OBJECT_FORMAT_FLOAT64BE: return SPA_AUDIO_FORMAT_F64_BE;
+	case AUDIO_OBJECT_FORMAT_ALAW:      return SPA_AUDIO_FORMAT_ALAW;
+	case AUDIO_OBJECT_FORMAT_ULAW:      return SPA_AUDIO_FORMAT_ULAW;
+	default:                            return SPA_AUDIO_FORMAT_UNKNOWN;
+	}
+}
+
+// The byte value of a silent sample.
+static uint8_t
+pipewire_silence(enum audio_object_format format)
+{
+	switch (format)
+	{
+	case AUDIO_OBJECT_FORMAT_U8:   return 0x80;
+	case AUDIO_OBJECT_FORMAT_ALAW: return 0xD5;
+	case AUDIO_OBJECT_FORMAT_ULAW: return 0xFF;
+	default:                       return 0;
+	}
+}
+
+/* The bytes queued in the ring buffer, ignoring the audio that has been
+ * flushed but not yet skipped by the process callback. */
+static uint32_t
+pipewire_queued(struct pipewire_object *self)
+{
+	uint32_t index;
+	int32_t filled = spa_ringbuffer_get_write_index(&self->ring, &index);
+	uint32_t flush_to = (uint32_t)audio_counter_get(&self->flush_to);
+	if (filled < 0)
+		return 0;
+	if ((int32_t)(flush_to - (index - filled)) > 0)
+		return index - flush_to;
+	return filled;
+}
+
+// The bytes that can be written to the ring buffer without blocking.
+static uint32_t
+pipewire_space(struct pipewire_object *self)
+{
+	uint32_t index;
+	int32_t filled = spa_ringbuffer_get_write_index(&self->ring, &index);
+	if (filled < 0 || (uint32_t)filled >= self->capacity)
+		return 0;
+	return self->capacity - filled;
+}
+
+static void
+pipewire_process(void *data)
+{
+	struct pipewire_object *self = data;
+
+	struct pw_buffer *b = pw_stream_dequeue_buffer(self->stream);
+	if (!b)
+		return;
+
+	struct spa_data *d = &b->buffer->datas[0];
+	if (!d->data) {
+		pw_stream_queue_buffer(self->stream, b);
+		return;
+	}
+
+	// Fill the quantum the graph asked for, or the whole buffer.
+	uint32_t bytes = d->maxsize - d->maxsize % self->frame_size;
+	if (b->requested && b->requested * self->frame_size < bytes)
+		bytes = b->requested * self->frame_size;
+
+	uint32_t index;
+	int32_t filled = spa_ringbuffer_get_read_index(&self->ring, &index);
+	uint32_t flush_to = (uint32_t)audio_counter_get(&self->flush_to);
+	if ((int32_t)(flush_to - index) > 0) {
+		// Skip the audio written before the last flush.
+		filled -= flush_to - index;
+		index = flush_to;
+	}
+	if (filled < 0)
+		filled = 0;
+
+	uint32_t count = (uint32_t)filled < bytes ? (uint32_t)filled : bytes;
+	if (count > 0)
+		spa_ringbuffer_read_data(&self->ring, self->buffer, self->size, index & (self->size - 1), d->data, count);
+	if (count < bytes) {
+		if (self->playing && !audio_counter_get(&self->draining))
+			audio_counter_add(&self->vtable.stats.underruns, 1);
+		memset((uint8_t *)d->data + count, self->silence, bytes - count);
+	}
+	self->playing = count == bytes;
+	spa_ringbuffer_read_update(&self->ring, index + count);
+
+	d->chunk->offset = 0;
+	d->chunk->stride = self->frame_size;
+	d->chunk->size = bytes;
+	pw_stream_queue_buffer(self->stream, b);
+
+	pw_loop_signal_event(pw_thread_loop_get_loop(self->loop), self->refill);
+}
+
+// Wake the writers waiting for space, on the thread loop.
+static void
+pipewire_refill(void *data,
+                uint64_t count)
+{
+	struct pipewire_object *self = data;
+	char c = 0;
+
+	pw_thread_loop_signal(self->loop, false);
+	// If the pipe is full, a wakeup is already pending.
+	if (self->wake[1] != -1 && write(self->wake[1], &c, 1) == -1)
+		return;
+}
+
+static void
+pipewire_state_changed(void *data,
+                       enum pw_stream_state old,
+                       enum pw_stream_state state,
+                       const char *error)
+{
+	struct pipewire_object *self = data;
+	self->state = state;
+	pw_thread_loop_signal(self->loop, false);
+}
+
+static void
+pipewire_drained(void *data)
+{
+	struct pipewire_object *self = data;
+	self->drained = 1;
+	pw_thread_loop_signal(self->loop, false);
+}
+
+static const struct pw_stream_events pipewire_stream_events =
+{
+	PW_VERSION_STREAM_EVENTS,
+	.state_changed = pipewire_state_changed,
+	.process = pipewire_process,
+	.drained = pipewire_drained,
+};
+
+// Wait for the thread loop to be signalled, with the lock held.
+static int
+pipewire_wait(struct pipewire_object *self,
+              uint64_t deadline)
+{
+	struct timespec abstime;
+	int remaining = audio_drain_remaining(deadline);
+	if (remaining < 0) {
+		pw_thread_loop_wait(self->loop);
+		return 0;
+	}
+	if (remaining == 0)
+		return -ETIMEDOUT;
+
+	pw_thread_loop_get_time(self->loop, &abstime, (int64_t)remaining * SPA_NSEC_PER_MSEC);
+	pw_thread_loop_timed_wait_full(self->loop, &abstime);
+	return 0;
+}
+
+// Check that the stream is still connected, with the lock held.
+static int
+pipewire_check(struct pipewire_object *self)
+{
+	switch (self->state)
+	{
+	case PW_STREAM_STATE_ERROR:       return -EIO;
+	case PW_STREAM_STATE_UNCONNECTED: return -EPIPE;
+	default:                          return 0;
+	}
+}
+
+static int
+pipewire_connect(struct pipewire_object *self,
+                 struct audio_object *object,
+                 enum audio_object_format format,
+                 uint8_t channels)
+{
+	uint8_t buffer[1024];
+	struct spa_pod_builder builder = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	const struct spa_pod *params[1];
+
+	// Ask for a quantum of one period, so the graph wakes the process
+	// callback as often as a sound card would.
+	uint32_t latency = object->negotiated.latency_us;
+	uint32_t period = object->buffering.period_us ? object->buffering.period_us : latency / 2;
+	uint32_t quantum = (uint64_t)self->rate * period / 1000000;
+	if (quantum == 0)
+		quantum = 1;
+
+	struct pw_properties *props = pw_properties_new(PW_KEY_MEDIA_TYPE, "Audio",
+	                                                PW_KEY_MEDIA_CATEGORY, "Playback",
+	                                                NULL);
+	if (!props)
+		return -ENOMEM;
+	pw_properties_setf(props, PW_KEY_NODE_LATENCY, "%u/%u", quantum, self->rate);
+	if (self->application_name)
+		pw_properties_set(props, PW_KEY_APP_NAME, self->application_name);
+	if (self->description)
+		pw_properties_set(props, PW_KEY_MEDIA_NAME, self->description);
+	if (self->device) {
+#ifdef PW_KEY_TARGET_OBJECT
+		pw_properties_set(props, PW_KEY_TARGET_OBJECT, self->device);
+#else
+		pw_properties_set(props, PW_KEY_NODE_TARGET, self->device);
+#endif
+	}
+
+	self->stream = pw_stream_new(self->core, self->description ? self->description : "pcaudiolib", props);
+	if (!self->stream)
+		return errno ? -errno : -ENOMEM;
+	self->state = PW_STREAM_STATE_UNCONNECTED;
+	pw_stream_add_listener(self->stream, &self->listener, &pipewire_stream_events, self);
+
+	struct spa_audio_info_raw info = SPA_AUDIO_INFO_RAW_INIT(
+		.format = pipewire_sample_format(format),
+		.rate = self->rate,
+		.channels = channels);
+	if (channels == 1)
+		info.position[0] = SPA_AUDIO_CHANNEL_MONO;
+	else if (channels == 2) {
+		info.position[0] = SPA_AUDIO_CHANNEL_FL;
+		info.position[1] = SPA_AUDIO_CHANNEL_FR;
+	} else
+		info.flags = SPA_AUDIO_FLAG_UNPOSITIONED;
+	params[0] = spa_format_audio_raw_build(&builder, SPA_PARAM_EnumFormat, &info);
+
+	int error = pw_stream_connect(self->stream,
+	                              PW_DIRECTION_OUTPUT,
+	                              PW_ID_ANY,
+	                              PW_STREAM_FLAG_AUTOCONNECT |
+	                              PW_STREAM_FLAG_MAP_BUFFERS |
+	                              PW_STREAM_FLAG_RT_PROCESS,
+	                              params, 1);
+	if (error < 0)
+		return error;
+
+	uint64_t deadline = audio_drain_deadline(OPEN_TIMEOUT_MS);
+	while (self->state != PW_STREAM_STATE_PAUSED && self->state != PW_STREAM_STATE_STREAMING) {
+		if (self->state == PW_STREAM_STATE_ERROR)
+			return -EIO;
+		if ((error = pipewire_wait(self, deadline)) != 0)
+			return error;
+	}
+
+	object->negotiated.period_us = (uint64_t)quantum * 1000000 / self->rate;
+	object->negotiated.periods = object->negotiated.period_us ? latency / object->negotiated.period_us : 0;
+	return 0;
+}
+
+// Destroy the stream, with the lock held.
+static void
+pipewire_disconnect(struct pipewire_object *self)
+{
+	if (!self->stream)
+		return;
+
+	pw_stream_disconnect(self->stream);
+	pw_stream_destroy(self->stream);
+	self->stream = NULL;
+}
+
+int
+pipewire_object_open(struct audio_object *object,
+                     enum audio_object_format format,
+                     uint32_t rate,
+                     uint8_t channels)
+{
+	struct pipewire_object *self = to_pipewire_object(object);
+	if (self->stream)
+		return -EEXIST;
+	if (rate == 0 || channels == 0 || channels > SPA_AUDIO_MAX_CHANNELS)
+		return -EINVAL;
+
+	format = audio_convert_nearest(format, pipewire_formats, sizeof(pipewire_formats) / sizeof(pipewire_formats[0]));
+	object->device_format = format;
+	if (pipewire_sample_format(format) == SPA_AUDIO_FORMAT_UNKNOWN)
+		return -EINVAL;
+
+	uint32_t period = object->buffering.period_us;
+	uint32_t latency = object->buffering.latency_us;
+	if (!latency)
+		latency = period && object->buffering.periods ? period * object->buffering.periods : period;
+	if (!latency)
+		latency = DEFAULT_LATENCY_US;
+
+	self->rate = rate;
+	self->frame_size = audio_object_format_size(format) * channels;
+	self->silence = pipewire_silence(format);
+	self->capacity = (uint64_t)rate * latency / 1000000 * self->frame_size;
+	if (self->capacity < self->frame_size)
+		self->capacity = self->frame_size;
+	for (self->size = 1; self->size < self->capacity; self->size <<= 1)
+		;
+	self->buffer = malloc(self->size);
+	if (!self->buffer)
+		return -ENOMEM;
+	spa_ringbuffer_init(&self->ring);
+	audio_counter_set(&self->flush_to, 0);
+	self->playing = 0;
+	self->drained = 0;
+	object->negotiated.latency_us = latency;
+
+	pw_thread_loop_lock(self->loop);
+	int error = pipewire_connect(self, object, format, channels);
+	if (error != 0)
+		pipewire_disconnect(self);
+	pw_thread_loop_unlock(self->loop);
+
+	if (error != 0) {
+		free(self->buffer);
+		self->buffer = NULL;
+	}
+	return error;
+}
+
+void
+pipewire_object_close(struct audio_object *object)
+{
+	struct pipewire_object *self = to_pipewire_object(object);
+	char buffer[16];
+
+	pw_thread_loop_lock(self->loop);
+	pipewire_disconnect(self);
+	pw_thread_loop_unlock(self->loop);
+
+	free(self->buffer);
+	self->buffer = NULL;
+	if (self->wake[0] != -1) {
+		while (read(self->wake[0], buffer, sizeof(buffer)) > 0)
+			;
+	}
+}
+
+void
+pipewire_object_forget(struct audio_object *object)
+{
+	struct pipewire_object *self = to_pipewire_object(object);
+
+	// The stream belongs to the parent's loop thread.
+	self->stream = NULL;
+	free(self->buffer);
+	self->buffer = NULL;
+}
+
+void
+pipewire_object_destroy(struct audio_object *object)
+{
+	struct pipewire_object *self = to_pipewire_object(object);
+
+	pipewire_object_close(object);
+	pw_thread_loop_stop(self->loop);
+	if (self->refill)
+		pw_loop_destroy_source(pw_thread_loop_get_loop(self->loop), self->refill);
+	if (self->core)
+		pw_core_disconnect(self->core);
+	if (self->context)
+		pw_context_destroy(self->context);
+	pw_thread_loop_destroy(self->loop);
+	pw_deinit();
+
+	if (self->wake[0] != -1) {
+		close(self->wake[0]);
+		close(self->wake[1]);
+	}
+	free(self->device);
+	free(self->application_name);
+	free(self->description);
+	free(self);
+}
+
+int
+pipewire_object_write(struct audio_object *object,
+                      const void *data,
+                      size_t bytes)
+{
+	struct pipewire_object *self = to_pipewire_object(object);
+	if (!self->stream)
+		return -EBADF;
+
+	while (bytes > 0) {
+		uint32_t space = pipewire_space(self);
+		if (space < self->frame_size) {
+			// Check again with the lock held, as the refill event that
+			// wakes this thread is handled with it held.
+			pw_thread_loop_lock(self->loop);
+			int error = pipewire_check(self);
+			if (error == 0 && audio_write_cancelled(object))
+				error = -ECANCELED;
+			if (error == 0 && pipewire_space(self) < self->frame_size)
+				pw_thread_loop_wait(self->loop);
+			pw_thread_loop_unlock(self->loop);
+			if (error != 0)
+				return error;
+			continue;
+		}
+
+		uint32_t index;
+		uint32_t count = space - space % self->frame_size;
+		if (count > bytes)
+			count = bytes;
+		spa_ringbuffer_get_write_index(&self->ring, &index);
+		spa_ringbuffer_write_data(&self->ring, self->buffer, self->size, index & (self->size - 1), data, count);
+		spa_ringbuffer_write_update(&self->ring, index + count);
+
+		data = (const uint8_t *)data + count;
+		bytes -= count;
+	}
+	return 0;
+}
+
+int
+pipewire_object_drain_until(struct audio_object *object,
+                            uint64_t deadline,
+                            uint64_t generation)
+{
+	struct pipewire_object *self = to_pipewire_object(object);
+	if (!self->stream)
+		return 0;
+
+	int error = 0;
+	int flushed = 0;
+	pw_thread_loop_lock(self->loop);
+	self->drained = 0;
+	audio_counter_set(&self->draining, 1);
+	for (;;) {
+		if (audio_counter_get(&object->drain_generation) != generation) {
+			error = -ECANCELED;
+			break;
+		}
+		if ((error = pipewire_check(self)) != 0)
+			break;
+
+		// Wait for the process callback to take the last of the audio,
+		// then for the graph to play it.
+		if (!flushed && pipewire_queued(self) == 0) {
+			if ((error = pw_stream_flush(self->stream, true)) < 0)
+				break;
+			flushed = 1;
+		}
+		if (self->drained)
+			break;
+		if ((error = pipewire_wait(self, deadline)) != 0)
+			break;
+	}
+	audio_counter_set(&self->draining, 0);
+	pw_thread_loop_unlock(self->loop);
+	return error;
+}
+
+int
+pipewire_object_drain(struct audio_object *object)
+{
+	return pipewire_object_drain_until(object, UINT64_MAX, audio_counter_get(&object->drain_generation));
+}
+
+void
+pipewire_object_wake(struct audio_object *object)
+{
+	struct pipewire_object *self = to_pipewire_object(object);
+
+	pw_thread_loop_lock(self->loop);
+	pw_thread_loop_signal(self->loop, false);
+	pw_thread_loop_unlock(self->loop);
+}
+
+int
+pipewire_object_flush(struct audio_object *object)
+{
+	struct pipewire_object *self = to_pipewire_object(object);
+	if (!self->stream)
+		return 0;
+
+	// The process callback owns the read index, so it skips the flushed
+	// audio the next time it runs.
+	uint32_t index;
+	spa_ringbuffer_get_write_index(&self->ring, &index);
+	audio_counter_set(&self->flush_to, index);
+
+	pw_thread_loop_lock(self->loop);
+	int error = pw_stream_flush(self->stream, false);
+	pw_thread_loop_unlock(self->loop);
+	return error < 0 ? error : 0;
+}
+
+int
+pipewire_object_set_standby(struct audio_object *object,
+                            int enable)
+{
+	struct pipewire_object *self = to_pipewire_object(object);
+	if (!self->stream)
+		return 0;
+
+	int error = enable ? pipewire_object_flush(object) : 0;
+	if (error != 0)
+		return error;
+
+	// An inactive stream is not scheduled, so no silence is played.
+	pw_thread_loop_lock(self->loop);
+	error = pw_stream_set_active(self->stream, !enable);
+	pw_thread_loop_unlock(self->loop);
+	return error < 0 ? error : 0;
+}
+
+int
+pipewire_object_delay(struct audio_object *object,
+                      size_t *frames)
+{
+	struct pipewire_object *self = to_pipewire_object(object);
+	struct pw_time time;
+
+	*frames = 0;
+	if (!self->stream)
+		return 0;
+
+	*frames = pipewire_queued(self) / self->frame_size;
+	if (pw_stream_get_time_n(self->stream, &time, sizeof(time)) == 0) {
+		// The delay to the device is in units of the graph rate, and the
+		// resampler holds `buffered` frames at the stream rate.
+		if (time.delay > 0 && time.rate.denom)
+			*frames += (uint64_t)time.delay * time.rate.num * self->rate / time.rate.denom;
+		*frames += time.buffered;
+	}
+	return 0;
+}
+
+int
+pipewire_object_get_pollfds(struct audio_object *object,
+                            struct audio_object_pollfd *fds,
+                            unsigned int space)
+{
+	struct pipewire_object *self = to_pipewire_object(object);
+	if (!self->stream || self->wake[0] == -1)
+		return -EBADF;
+
+	if (space > 0) {
+		fds[0].fd = self->wake[0];
+		fds[0].events = POLLIN;
+		fds[0].revents = 0;
+	}
+	return 1;
+}
+
+int
+pipewire_object_service(struct audio_object *object,
+                        const struct audio_object_pollfd *fds,
+                        unsigned int nfds,
+                        size_t *frames)
+{
+	struct pipewire_object *self = to_pipewire_object(object);
+	char buffer[16];
+
+	*frames = 0;
+	if (!self->stream)
+		return -EBADF;
+
+	while (read(self->wake[0], buffer, sizeof(buffer)) > 0)
+		;
+
+	pw_thread_loop_lock(self->loop);
+	int error = pipewire_check(self);
+	pw_thread_loop_unlock(self->loop);
+	if (error == 0)
+		*frames = pipewire_space(self) / self->frame_size;
+	return error;
+}
+
+const char *
+pipewire_object_strerror(struct audio_object *object,
+                         int error)
+{
+	return strerror(error < 0 ? -error : error);
+}
+
+struct audio_object *
+create_pipewire_object(const char *device,
+                       const char *application_name,
+                       const char *description)
+{
+	struct pipewire_object *self = calloc(1, sizeof(struct pipewire_object));
+	if (!self)
+		return NULL;
+
+	pw_init(NULL, NULL);
+
+	// Connecting to the daemon fails straight away if it is not running,
+	// so this is also the check that PipeWire is available.
+	self->loop = pw_thread_loop_new("pcaudiolib", NULL);
+	if (self->loop)
+		self->context = pw_context_new(pw_thread_loop_get_loop(self->loop), NULL, 0);
+	if (self->context)
+		self->core = pw_context_connect(self->context, NULL, 0);
+	if (self->core)
+		self->refill = pw_loop_add_event(pw_thread_loop_get_loop(self->loop), pipewire_refill, self);
+	if (!self->refill || pw_thread_loop_start(self->loop) < 0) {
+		if (self->core)
+			pw_core_disconnect(self->core);
+		if (self->context)
+			pw_context_destroy(self->context);
+		if (self->loop)
+			pw_thread_loop_destroy(self->loop);
+		pw_deinit();
+		free(self);
+		return NULL;
+	}
+
+	self->stream = NULL;
+	self->device = device ? strdup(device) : NULL;
+	self->application_name = application_name ? strdup(application_name) : NULL;
+	self->description = description ? strdup(description) : NULL;
+	if (pipe(self->wake) == 0) {
+		for (int i = 0; i < 2; ++i) {
+			fcntl(self->wake[i], F_SETFL, O_NONBLOCK);
+			fcntl(self->wake[i], F_SETFD, FD_CLOEXEC);
+		}
+	} else
+		self->wake[0] = self->wake[1] = -1;
+
+	self->vtable.open = pipewire_object_open;
+	self->vtable.close = pipewire_object_close;
+	self->vtable.forget = pipewire_object_forget;
+	self->vtable.destroy = pipewire_object_destroy;
+	self->vtable.write = pipewire_object_write;
+	self->vtable.drain = pipewire_object_drain;
+	self->vtable.flush = pipewire_object_flush;
+	self->vtable.strerror = pipewire_object_strerror;
+	self->vtable.delay = pipewire_object_delay;
+	self->vtable.drain_until = pipewire_object_drain_until;
+	self->vtable.wake = pipewire_object_wake;
+	self->vtable.set_standby = pipewire_object_set_standby;
+	self->vtable.get_pollfds = pipewire_object_get_pollfds;
+	self->vtable.service = pipewire_object_service;
+
+	return &self->vtable;
+}
+
+#else
+
+struct audio_object *
+create_pipewire_object(const char *device,
+                       const char *application_name,
+                       const char *description)
+{
+	return NULL;
+}
+
+#endif
@@ -0,0 +1,290 @@
+/* Device Handle Pool.
+ *
+ * Copyright (C) 2026 Reece H. Dunn
+ *
+ * This file is part of pcaudiolib.
+ *
+ * pcaudiolib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pcaudiolib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pcaudiolib.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "audio_priv.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+void
+audio_pool_key_init(struct audio_pool_key *key,
+                    struct audio_object *object,
+                    const char *backend,
+                    const char *device,
+                    const char *application_name,
+                    const char *description,
+                    enum audio_object_format format,
+                    uint32_t rate,
+                    uint8_t channels)
+{
+	memset(key, 0, sizeof(*key));
+	key->backend = backend;
+	key->device = device;
+	key->application_name = application_name;
+	key->description = description;
+	key->format = format;
+	key->rate = rate;
+	key->channels = channels;
+	key->resample_quality = object->resample_quality;
+	key->buffering = object->buffering;
+	key->thresholds = object->thresholds;
+}
+
+#if defined(HAVE_PTHREAD_H)
+
+#include <pthread.h>
+
+/* The pool is a list of idle handles, most recently returned first, so a
+ * lookup finds the warmest matching handle and the least recently used one
+ * is at the end of the list when the pool is full. */
+struct audio_pool_entry
+{
+	struct audio_pool_entry *next;
+	struct audio_pool_key key;   // the strings are owned by the entry
+	void *handle;
+	void (*release)(void *handle);
+};
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static struct audio_pool_entry *pool_entries;
+static size_t pool_count;
+static size_t pool_limit;
+
+static void
+pool_entry_free(struct audio_pool_entry *entry)
+{
+	free((char *)entry->key.backend);
+	free((char *)entry->key.device);
+	free((char *)entry->key.application_name);
+	free((char *)entry->key.description);
+	free(entry);
+}
+
+static void
+pool_atfork_prepare(void)
+{
+	pthread_mutex_lock(&pool_mutex);
+}
+
+static void
+pool_atfork_parent(void)
+{
+	pthread_mutex_unlock(&pool_mutex);
+}
+
+// The pooled handles share their descriptors (and for PulseAudio, mainloop
+// threads that do not exist in the child) with the parent, so the child
+// forgets them without closing them.
+static void
+pool_atfork_child(void)
+{
+	struct audio_pool_entry *entry = pool_entries;
+	while (entry) {
+		struct audio_pool_entry *next = entry->next;
+		pool_entry_free(entry);
+		entry = next;
+	}
+	pool_entries = NULL;
+	pool_count = 0;
+	pthread_mutex_unlock(&pool_mutex);
+}
+
+static void
+pool_init(void)
+{
+	const char *size = getenv("PCAUDIO_POOL_SIZE");
+	if (size && atol(size) > 0)
+		pool_limit = (size_t)atol(size);
+	pthread_atfork(pool_atfork_prepare, pool_atfork_parent, pool_atfork_child);
+}
+
+static int
+pool_string_equal(const char *a,
+                  const char *b)
+{
+	return a == b || (a && b && !strcmp(a, b));
+}
+
+static int
+pool_key_equal(const struct audio_pool_key *a,
+               const struct audio_pool_key *b)
+{
+	return pool_string_equal(a->backend, b->backend) &&
+	       pool_string_equal(a->device, b->device) &&
+	       pool_string_equal(a->application_name, b->application_name) &&
+	       pool_string_equal(a->description, b->description) &&
+	       a->format == b->format &&
+	       a->rate == b->rate &&
+	       a->channels == b->channels &&
+	       a->resample_quality == b->resample_quality &&
+	       !memcmp(&a->buffering, &b->buffering, sizeof(a->buffering)) &&
+	       !memcmp(&a->thresholds, &b->thresholds, sizeof(a->thresholds));
+}
+
+// Release the handles in a list of entries taken out of the pool. This is
+// done without the mutex held, as closing a device can block.
+static void
+pool_release(struct audio_pool_entry *entry)
+{
+	while (entry) {
+		struct audio_pool_entry *next = entry->next;
+		entry->release(entry->handle);
+		pool_entry_free(entry);
+		entry = next;
+	}
+}
+
+// Take the entries after the first `limit` out of the pool. Must be called
+// with the mutex held.
+static struct audio_pool_entry *
+pool_trim(size_t limit)
+{
+	struct audio_pool_entry **item = &pool_entries;
+	for (size_t i = 0; *item && i < limit; ++i)
+		item = &(*item)->next;
+
+	struct audio_pool_entry *evicted = *item;
+	*item = NULL;
+	pool_count = pool_count < limit ? pool_count : limit;
+	return evicted;
+}
+
+int
+audio_pool_enabled(void)
+{
+	pthread_once(&pool_once, pool_init);
+	pthread_mutex_lock(&pool_mutex);
+	int enabled = pool_limit != 0;
+	pthread_mutex_unlock(&pool_mutex);
+	return enabled;
+}
+
+void *
+audio_pool_get(const struct audio_pool_key *key)
+{
+	void *handle = NULL;
+
+	pthread_once(&pool_once, pool_init);
+	pthread_mutex_lock(&pool_mutex);
+	for (struct audio_pool_entry **item = &pool_entries; *item; item = &(*item)->next) {
+		struct audio_pool_entry *entry = *item;
+		if (pool_key_equal(&entry->key, key)) {
+			*item = entry->next;
+			--pool_count;
+			handle = entry->handle;
+			pool_entry_free(entry);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&pool_mutex);
+	return handle;
+}
+
+static char *
+pool_strdup(const char *value,
+            int *ok)
+{
+	if (!value)
+		return NULL;
+	char *copy = strdup(value);
+	if (!copy)
+		*ok = 0;
+	return copy;
+}
+
+void
+audio_pool_put(const struct audio_pool_key *key,
+               void *handle,
+               void (*release)(void *handle))
+{
+	int ok = 1;
+	struct audio_pool_entry *entry = calloc(1, sizeof(struct audio_pool_entry));
+	if (!entry) {
+		release(handle);
+		return;
+	}
+
+	entry->key = *key;
+	entry->key.backend = pool_strdup(key->backend, &ok);
+	entry->key.device = pool_strdup(key->device, &ok);
+	entry->key.application_name = pool_strdup(key->application_name, &ok);
+	entry->key.description = pool_strdup(key->description, &ok);
+	entry->handle = handle;
+	entry->release = release;
+
+	pthread_once(&pool_once, pool_init);
+	pthread_mutex_lock(&pool_mutex);
+	struct audio_pool_entry *evicted = entry;
+	if (ok && pool_limit != 0) {
+		entry->next = pool_entries;
+		pool_entries = entry;
+		++pool_count;
+		evicted = pool_count > pool_limit ? pool_trim(pool_limit) : NULL;
+	}
+	pthread_mutex_unlock(&pool_mutex);
+
+	pool_release(evicted);
+}
+
+int
+audio_pool_set_limit(size_t handles)
+{
+	pthread_once(&pool_once, pool_init);
+	pthread_mutex_lock(&pool_mutex);
+	pool_limit = handles;
+	struct audio_pool_entry *evicted = pool_trim(handles);
+	pthread_mutex_unlock(&pool_mutex);
+
+	pool_release(evicted);
+	return 0;
+}
+
+#else
+
+int
+audio_pool_enabled(void)
+{
+	return 0;
+}
+
+void *
+audio_pool_get(const struct audio_pool_key *key)
+{
+	return NULL;
+}
+
+void
+audio_pool_put(const struct audio_pool_key *key,
+               void *handle,
+               void (*release)(void *handle))
+{
+	release(handle);
+}
+
+int
+audio_pool_set_limit(size_t handles)
+{
+	return handles ? -ENOSYS : 0;
+}
+
+#endif
@@ -20,13 +20,28 @@
 
 #include "config.h"
 #include "audio_priv.h"
+#include "trace.h"
 
 #ifdef HAVE_PULSE_SIMPLE_H
 
 #include <pulse/error.h>
+#include <pulse/mainloop.h>
+#include <pulse/thread-mainloop.h>
+#include <pulse/context.h>
+#include <pulse/introspect.h>
+#include <pulse/rtclock.h>
 #include <pulse/simple.h>
-#include <string.h>
+#include <pulse/stream.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 struct pulseaudio_object
 {
@@ -36,10 +51,93 @@ struct pulseaudio_object
 	char *device;
 	char *application_name;
 	char *description;
+	struct audio_pool_key key; // the handle pool key the stream was opened with
 };
 
 #define to_pulseaudio_object(object) container_of(object, struct pulseaudio_object, vtable)
 
+/* A simple API stream kept in the handle pool. */
+struct pulseaudio_simple_handle
+{
+	pa_simple *s;
+	pa_sample_spec ss;
+	enum audio_object_format device_format;
+	struct audio_buffering negotiated;
+};
+
+static void
+pulseaudio_simple_handle_release(void *data)
+{
+	struct pulseaudio_simple_handle *pooled = data;
+	pa_simple_free(pooled->s);
+	free(pooled);
+}
+
+static const enum audio_object_format pulseaudio_formats[] =
+{
+	AUDIO_OBJECT_FORMAT_U8,
+	AUDIO_OBJECT_FORMAT_S16LE,
+	AUDIO_OBJECT_FORMAT_S16BE,
+#ifdef PA_SAMPLE_S24LE
+	AUDIO_OBJECT_FORMAT_S24LE,
+	AUDIO_OBJECT_FORMAT_S24BE,
+	AUDIO_OBJECT_FORMAT_S24_32LE,
+	AUDIO_OBJECT_FORMAT_S24_32BE,
+#endif
+	AUDIO_OBJECT_FORMAT_S32LE,
+	AUDIO_OBJECT_FORMAT_S32BE,
+	AUDIO_OBJECT_FORMAT_FLOAT32LE,
+	AUDIO_OBJECT_FORMAT_FLOAT32BE,
+};
+
+static pa_sample_format_t
+pulseaudio_sample_format(enum audio_object_format format)
+{
+	switch (format)
+	{
+	case AUDIO_OBJECT_FORMAT_ALAW:      return PA_SAMPLE_ALAW;
+	case AUDIO_OBJECT_FORMAT_ULAW:      return PA_SAMPLE_ULAW;
+	case AUDIO_OBJECT_FORMAT_U8:        return PA_SAMPLE_U8;
+	case AUDIO_OBJECT_FORMAT_S16LE:     return PA_SAMPLE_S16LE;
+	case AUDIO_OBJECT_FORMAT_S16BE:     return PA_SAMPLE_S16BE;
+#ifdef PA_SAMPLE_S24LE
+	case AUDIO_OBJECT_FORMAT_S24LE:     return PA_SAMPLE_S24LE;
+	case AUDIO_OBJECT_FORMAT_S24BE:     return PA_SAMPLE_S24BE;
+	case AUDIO_OBJECT_FORMAT_S24_32LE:  return PA_SAMPLE_S24_32LE;
+	case AUDIO_OBJECT_FORMAT_S24_32BE:  return PA_SAMPLE_S24_32BE;
+#endif
+	case AUDIO_OBJECT_FORMAT_S32LE:     return PA_SAMPLE_S32LE;
+	case AUDIO_OBJECT_FORMAT_S32BE:     return PA_SAMPLE_S32BE;
+	case AUDIO_OBJECT_FORMAT_FLOAT32LE: return PA_SAMPLE_FLOAT32LE;
+	case AUDIO_OBJECT_FORMAT_FLOAT32BE: return PA_SAMPLE_FLOAT32BE;
+	default:                            return PA_SAMPLE_INVALID;
+	}
+}
+
+// The latency requested with audio_object_set_buffering.
+static uint32_t
+pulseaudio_latency(struct audio_object *object)
+{
+	uint32_t period = object->buffering.period_us;
+	uint32_t latency = object->buffering.latency_us;
+	if (!latency)
+		latency = period && object->buffering.periods ? period * object->buffering.periods : period;
+	if (!latency)
+		latency = DEFAULT_LATENCY_US;
+	return latency;
+}
+
+// Report an error from a PulseAudio call to the pulse_error probe.
+static int
+pulseaudio_object_error(struct audio_object *object,
+                        const char *operation,
+                        int error)
+{
+	if (error != 0)
+		AUDIO_PROBE3(pulse_error, object, operation, error);
+	return error;
+}
+
 int
 pulseaudio_object_open(struct audio_object *object,
                        enum audio_object_format format,
@@ -50,37 +148,37 @@ pulseaudio_object_open(struct audio_object *object,
 	if (self->s)
 		return PA_ERR_EXIST;
 
+	audio_pool_key_init(&self->key, object, "pulseaudio-simple", self->device,
+	                    self->application_name, self->description, format, rate, channels);
+	struct pulseaudio_simple_handle *pooled = audio_pool_get(&self->key);
+	if (pooled) {
+		self->s = pooled->s;
+		self->ss = pooled->ss;
+		object->device_format = pooled->device_format;
+		object->negotiated = pooled->negotiated;
+		free(pooled);
+		return 0;
+	}
+
 	self->ss.rate = rate;
 	self->ss.channels = channels;
 
-	switch (format)
-	{
-	case AUDIO_OBJECT_FORMAT_ALAW:      self->ss.format = PA_SAMPLE_ALAW;      break;
-	case AUDIO_OBJECT_FORMAT_ULAW:      self->ss.format = PA_SAMPLE_ULAW;      break;
-	case AUDIO_OBJECT_FORMAT_U8:        self->ss.format = PA_SAMPLE_U8;        break;
-	case AUDIO_OBJECT_FORMAT_S16LE:     self->ss.format = PA_SAMPLE_S16LE;     break;
-	case AUDIO_OBJECT_FORMAT_S16BE:     self->ss.format = PA_SAMPLE_S16BE;     break;
-#ifdef PA_SAMPLE_S24LE
-	case AUDIO_OBJECT_FORMAT_S24LE:     self->ss.format = PA_SAMPLE_S24LE;     break;
-	case AUDIO_OBJECT_FORMAT_S24BE:     self->ss.format = PA_SAMPLE_S24BE;     break;
-	case AUDIO_OBJECT_FORMAT_S24_32LE:  self->ss.format = PA_SAMPLE_S24_32LE;  break;
-	case AUDIO_OBJECT_FORMAT_S24_32BE:  self->ss.format = PA_SAMPLE_S24_32BE;  break;
-#endif
-	case AUDIO_OBJECT_FORMAT_S32LE:     self->ss.format = PA_SAMPLE_S32LE;     break;
-	case AUDIO_OBJECT_FORMAT_S32BE:     self->ss.format = PA_SAMPLE_S32BE;     break;
-	case AUDIO_OBJECT_FORMAT_FLOAT32LE: self->ss.format = PA_SAMPLE_FLOAT32LE; break;
-	case AUDIO_OBJECT_FORMAT_FLOAT32BE: self->ss.format = PA_SAMPLE_FLOAT32BE; break;
-	default:                            return PA_ERR_INVALID; // Invalid argument.
-	}
+	format = audio_convert_nearest(format, pulseaudio_formats, sizeof(pulseaudio_formats) / sizeof(pulseaudio_formats[0]));
+	object->device_format = format;
+	if ((self->ss.format = pulseaudio_sample_format(format)) == PA_SAMPLE_INVALID)
+		return PA_ERR_INVALID; // Invalid argument.
 
 	int error = 0;
 	pa_buffer_attr battr;
 
+	uint32_t period = object->buffering.period_us;
+	uint32_t latency = pulseaudio_latency(object);
+
 	battr.fragsize = (uint32_t) -1;
 	battr.maxlength = (uint32_t) -1;
-	battr.minreq = (uint32_t) -1;
+	battr.minreq = period ? pa_usec_to_bytes(period, &self->ss) : (uint32_t) -1;
 	battr.prebuf = (uint32_t) -1;
-	battr.tlength = pa_usec_to_bytes(LATENCY * 1000, &self->ss);
+	battr.tlength = pa_usec_to_bytes(latency, &self->ss);
 	self->s = pa_simple_new(NULL,
 	                        self->application_name,
 	                        PA_STREAM_PLAYBACK,
@@ -90,13 +188,35 @@ pulseaudio_object_open(struct audio_object *object,
 	                        NULL,
 	                        &battr,
 	                        &error);
-	return error;
+
+	// The simple API does not report the buffer attributes the server
+	// chose, so report the ones that were requested.
+	if (self->s) {
+		object->negotiated.latency_us = latency;
+		if (period) {
+			object->negotiated.period_us = period;
+			object->negotiated.periods = latency / period;
+		}
+	}
+	return pulseaudio_object_error(object, "open", error);
 }
 
 void
 pulseaudio_object_close(struct audio_object *object)
 {
 	struct pulseaudio_object *self = to_pulseaudio_object(object);
+	struct pulseaudio_simple_handle *pooled;
+	int error = 0;
+
+	if (self->s && audio_pool_enabled() && pa_simple_flush(self->s, &error) == 0 &&
+	    (pooled = malloc(sizeof(struct pulseaudio_simple_handle))) != NULL) {
+		pooled->s = self->s;
+		pooled->ss = self->ss;
+		pooled->device_format = object->device_format;
+		pooled->negotiated = object->negotiated;
+		audio_pool_put(&self->key, pooled, pulseaudio_simple_handle_release);
+		self->s = NULL;
+	}
 
 	if (self->s) {
 		pa_simple_free(self->s);
@@ -104,6 +224,16 @@ pulseaudio_object_close(struct audio_object *object)
 	}
 }
 
+void
+pulseaudio_object_forget(struct audio_object *object)
+{
+	struct pulseaudio_object *self = to_pulseaudio_object(object);
+
+	// The stream is the parent's, and its mainloop thread is not running
+	// in this process.
+	self->s = NULL;
+}
+
 void
 pulseaudio_object_destroy(struct audio_object *object)
 {
@@ -124,7 +254,7 @@ pulseaudio_object_drain(struct audio_object *object)
 
 	int error = 0;
 	pa_simple_drain(self->s, &error);
-	return error;
+	return pulseaudio_object_error(object, "drain", error);
 }
 
 int
@@ -136,7 +266,7 @@ pulseaudio_object_flush(struct audio_object *object)
 
 	int error = 0;
 	pa_simple_flush(self->s, &error);
-	return error;
+	return pulseaudio_object_error(object, "flush", error);
 }
 
 int
@@ -150,41 +280,1014 @@ pulseaudio_object_write(struct audio_object *object,
 
 	int error = 0;
 	pa_simple_write(self->s, data, bytes, &error);
-	return error;
+	return pulseaudio_object_error(object, "write", error);
+}
+
+int
+pulseaudio_object_delay(struct audio_object *object,
+                        size_t *frames)
+{
+	struct pulseaudio_object *self = to_pulseaudio_object(object);
+	*frames = 0;
+	if (!self->s)
+		return 0;
+
+	int error = 0;
+	pa_usec_t latency = pa_simple_get_latency(self->s, &error);
+	if (latency != (pa_usec_t) -1)
+		*frames = latency * self->ss.rate / PA_USEC_PER_SEC;
+	return pulseaudio_object_error(object, "delay", error);
 }
 
 const char *
 pulseaudio_object_strerror(struct audio_object *object,
                            int error)
 {
+	// Negative errors are errno values, such as -ETIMEDOUT from a drain.
+	if (error < 0)
+		return strerror(-error);
 	return pa_strerror(error);
 }
 
+/* The stream backend uses the asynchronous API on a threaded mainloop. This
+ * lets it tune the buffer for a fast start, pipeline the cork, flush and
+ * uncork of a flush instead of waiting for each reply, write into the server
+ * memory, and report the delay from the interpolated timing information
+ * without a round-trip to the server.
+ *
+ * The mainloop lock protects the context and stream. The callbacks run on
+ * the mainloop thread with the lock held, and signal the threads waiting in
+ * pa_threaded_mainloop_wait.
+ */
+struct pulseaudio_stream
+{
+	struct audio_object vtable;
+	pa_threaded_mainloop *mainloop;
+	pa_context *context;
+	pa_stream *stream;
+	pa_sample_spec ss;
+	size_t frame_size;
+	char *device;
+	char *application_name;
+	char *description;
+
+	int wake[2];         // readable when the server requests audio, for get_pollfds
+	void *write_buffer;  // returned by pa_stream_begin_write, until it is committed
+
+	pa_operation *drain; // the drain in progress
+	int drain_success;
+	int timed_out;
+
+	struct audio_pool_key key; // the handle pool key the stream was opened with
+};
+
+#define to_pulseaudio_stream(object) container_of(object, struct pulseaudio_stream, vtable)
+
+/* A stream kept in the handle pool, corked, with the mainloop and context
+ * it belongs to. */
+struct pulseaudio_stream_handle
+{
+	pa_threaded_mainloop *mainloop;
+	pa_context *context;
+	pa_stream *stream;
+	pa_sample_spec ss;
+	size_t frame_size;
+	enum audio_object_format device_format;
+	struct audio_buffering negotiated;
+};
+
+static void
+pulseaudio_stream_signal(struct pulseaudio_stream *self)
+{
+	pa_threaded_mainloop_signal(self->mainloop, 0);
+}
+
+static void
+pulseaudio_stream_context_state(pa_context *context,
+                                void *userdata)
+{
+	pulseaudio_stream_signal(userdata);
+}
+
+static void
+pulseaudio_stream_state(pa_stream *stream,
+                        void *userdata)
+{
+	pulseaudio_stream_signal(userdata);
+}
+
+static void
+pulseaudio_stream_request(pa_stream *stream,
+                          size_t bytes,
+                          void *userdata)
+{
+	struct pulseaudio_stream *self = userdata;
+	char c = 0;
+
+	pulseaudio_stream_signal(self);
+	// If the pipe is full, a wakeup is already pending.
+	if (self->wake[1] != -1 && write(self->wake[1], &c, 1) == -1)
+		return;
+}
+
+static void
+pulseaudio_stream_underflow(pa_stream *stream,
+                            void *userdata)
+{
+	struct pulseaudio_stream *self = userdata;
+	audio_counter_add(&self->vtable.stats.underruns, 1);
+}
+
+static void
+pulseaudio_stream_drained(pa_stream *stream,
+                          int success,
+                          void *userdata)
+{
+	struct pulseaudio_stream *self = userdata;
+	self->drain_success = success;
+	pulseaudio_stream_signal(self);
+}
+
+static void
+pulseaudio_stream_timeout(pa_mainloop_api *api,
+                          pa_time_event *event,
+                          const struct timeval *tv,
+                          void *userdata)
+{
+	struct pulseaudio_stream *self = userdata;
+	self->timed_out = 1;
+	pulseaudio_stream_signal(self);
+}
+
+// The error for a failed call, with the mainloop lock held.
+static int
+pulseaudio_stream_errno(struct pulseaudio_stream *self)
+{
+	int error = self->context ? pa_context_errno(self->context) : PA_ERR_BADSTATE;
+	return error != 0 ? error : PA_ERR_UNKNOWN;
+}
+
+// Check that the stream is playing, with the mainloop lock held.
+static int
+pulseaudio_stream_check(struct pulseaudio_stream *self)
+{
+	if (!PA_CONTEXT_IS_GOOD(pa_context_get_state(self->context)) ||
+	    !PA_STREAM_IS_GOOD(pa_stream_get_state(self->stream)))
+		return pulseaudio_stream_errno(self);
+	return 0;
+}
+
+// Connect to the server, with the mainloop lock held. The context is kept
+// between streams, and only connected again if the server goes away.
+static int
+pulseaudio_stream_connect(struct pulseaudio_stream *self)
+{
+	pa_context_state_t state;
+
+	if (self->context) {
+		if (pa_context_get_state(self->context) == PA_CONTEXT_READY)
+			return 0;
+		pa_context_set_state_callback(self->context, NULL, NULL);
+		pa_context_disconnect(self->context);
+		pa_context_unref(self->context);
+	}
+
+	self->context = pa_context_new(pa_threaded_mainloop_get_api(self->mainloop),
+	                               self->application_name ? self->application_name : "pcaudiolib");
+	if (!self->context)
+		return PA_ERR_INTERNAL;
+
+	pa_context_set_state_callback(self->context, pulseaudio_stream_context_state, self);
+	if (pa_context_connect(self->context, NULL, PA_CONTEXT_NOFLAGS, NULL) < 0)
+		return pulseaudio_stream_errno(self);
+
+	while ((state = pa_context_get_state(self->context)) != PA_CONTEXT_READY) {
+		if (!PA_CONTEXT_IS_GOOD(state))
+			return pulseaudio_stream_errno(self);
+		pa_threaded_mainloop_wait(self->mainloop);
+	}
+	return 0;
+}
+
+// Set the stream callbacks to `self`, or remove them if it is NULL, with
+// the mainloop lock held.
+static void
+pulseaudio_stream_set_callbacks(pa_stream *stream,
+                                struct pulseaudio_stream *self)
+{
+	pa_stream_set_state_callback(stream, self ? pulseaudio_stream_state : NULL, self);
+	pa_stream_set_write_callback(stream, self ? pulseaudio_stream_request : NULL, self);
+	pa_stream_set_underflow_callback(stream, self ? pulseaudio_stream_underflow : NULL, self);
+}
+
+// Disconnect the stream, with the mainloop lock held.
+static void
+pulseaudio_stream_disconnect(struct pulseaudio_stream *self)
+{
+	if (!self->stream)
+		return;
+
+	pulseaudio_stream_set_callbacks(self->stream, NULL);
+	pa_stream_disconnect(self->stream);
+	pa_stream_unref(self->stream);
+	self->stream = NULL;
+	self->write_buffer = NULL;
+}
+
+// Disconnect a stream and context, and free the mainloop they belong to.
+static void
+pulseaudio_free_mainloop(pa_threaded_mainloop *mainloop,
+                         pa_context *context,
+                         pa_stream *stream)
+{
+	pa_threaded_mainloop_lock(mainloop);
+	if (stream) {
+		pulseaudio_stream_set_callbacks(stream, NULL);
+		pa_stream_disconnect(stream);
+		pa_stream_unref(stream);
+	}
+	if (context) {
+		pa_context_set_state_callback(context, NULL, NULL);
+		pa_context_disconnect(context);
+	}
+	pa_threaded_mainloop_unlock(mainloop);
+
+	pa_threaded_mainloop_stop(mainloop);
+	if (context)
+		pa_context_unref(context);
+	pa_threaded_mainloop_free(mainloop);
+}
+
+static void
+pulseaudio_stream_free_mainloop(struct pulseaudio_stream *self)
+{
+	if (self->mainloop)
+		pulseaudio_free_mainloop(self->mainloop, self->context, self->stream);
+	self->mainloop = NULL;
+	self->context = NULL;
+	self->stream = NULL;
+	self->write_buffer = NULL;
+}
+
+static void
+pulseaudio_stream_handle_release(void *data)
+{
+	struct pulseaudio_stream_handle *pooled = data;
+	pulseaudio_free_mainloop(pooled->mainloop, pooled->context, pooled->stream);
+	free(pooled);
+}
+
+static int
+pulseaudio_stream_connect_playback(struct pulseaudio_stream *self,
+                                   struct audio_object *object)
+{
+	pa_buffer_attr battr;
+	pa_stream_state_t state;
+	int error;
+
+	if ((error = pulseaudio_stream_connect(self)) != 0)
+		return error;
+
+	self->stream = pa_stream_new(self->context,
+	                             self->description ? self->description : "pcaudiolib",
+	                             &self->ss,
+	                             NULL);
+	if (!self->stream)
+		return pulseaudio_stream_errno(self);
+
+	pulseaudio_stream_set_callbacks(self->stream, self);
+
+	// With PA_STREAM_ADJUST_LATENCY, tlength is the latency of the whole
+	// path to the sink. Playback starts once prebuf bytes have been written
+	// instead of the whole of tlength, so the first audio is heard as soon
+	// as a period is available.
+	// audio_object_set_thresholds can override both.
+	uint32_t period = object->buffering.period_us;
+	uint32_t latency = pulseaudio_latency(object);
+	uint32_t start = object->thresholds.start_us;
+	if (object->thresholds.avail_min_us)
+		period = object->thresholds.avail_min_us;
+
+	battr.fragsize = (uint32_t) -1;
+	battr.maxlength = (uint32_t) -1;
+	battr.tlength = pa_usec_to_bytes(latency, &self->ss);
+	battr.minreq = period ? pa_usec_to_bytes(period, &self->ss) : (uint32_t) -1;
+	if (start && start != AUDIO_OBJECT_START_IMMEDIATE)
+		battr.prebuf = pa_usec_to_bytes(start, &self->ss);
+	else
+		battr.prebuf = period ? battr.minreq : battr.tlength / 4;
+	if (battr.prebuf > battr.tlength)
+		battr.prebuf = battr.tlength;
+	if (battr.prebuf < self->frame_size)
+		battr.prebuf = self->frame_size;
+
+	pa_stream_flags_t flags = PA_STREAM_INTERPOLATE_TIMING |
+	                          PA_STREAM_AUTO_TIMING_UPDATE |
+	                          PA_STREAM_ADJUST_LATENCY;
+	if (pa_stream_connect_playback(self->stream, self->device, &battr, flags, NULL, NULL) < 0)
+		return pulseaudio_stream_errno(self);
+
+	while ((state = pa_stream_get_state(self->stream)) != PA_STREAM_READY) {
+		if (!PA_STREAM_IS_GOOD(state))
+			return pulseaudio_stream_errno(self);
+		pa_threaded_mainloop_wait(self->mainloop);
+	}
+
+	const pa_buffer_attr *attr = pa_stream_get_buffer_attr(self->stream);
+	if (attr) {
+		object->negotiated.latency_us = pa_bytes_to_usec(attr->tlength, &self->ss);
+		object->negotiated.period_us = pa_bytes_to_usec(attr->minreq, &self->ss);
+		object->negotiated.periods = attr->minreq ? attr->tlength / attr->minreq : 0;
+	}
+	return 0;
+}
+
+// Take over a stream from the handle pool, with its mainloop and context.
+static int
+pulseaudio_stream_adopt(struct pulseaudio_stream *self,
+                        struct pulseaudio_stream_handle *pooled)
+{
+	pulseaudio_stream_free_mainloop(self);
+	self->mainloop = pooled->mainloop;
+	self->context = pooled->context;
+	self->stream = pooled->stream;
+	self->ss = pooled->ss;
+	self->frame_size = pooled->frame_size;
+	self->vtable.device_format = pooled->device_format;
+	self->vtable.negotiated = pooled->negotiated;
+	free(pooled);
+
+	pa_threaded_mainloop_lock(self->mainloop);
+	pa_context_set_state_callback(self->context, pulseaudio_stream_context_state, self);
+	pulseaudio_stream_set_callbacks(self->stream, self);
+	int error = pulseaudio_stream_check(self);
+	if (error == 0) {
+		pa_operation *op = pa_stream_cork(self->stream, 0, NULL, NULL);
+		if (op)
+			pa_operation_unref(op);
+		else
+			error = pulseaudio_stream_errno(self);
+	}
+	if (error != 0)
+		pulseaudio_stream_disconnect(self);
+	pa_threaded_mainloop_unlock(self->mainloop);
+	return error;
+}
+
+// Cork the stream and return it to the handle pool with its mainloop and
+// context. The object starts a new mainloop if it is opened again.
+static void
+pulseaudio_stream_pool(struct pulseaudio_stream *self)
+{
+	if (!self->stream || !audio_pool_enabled())
+		return;
+
+	struct pulseaudio_stream_handle *pooled = malloc(sizeof(struct pulseaudio_stream_handle));
+	if (!pooled)
+		return;
+
+	pa_operation *ops[2];
+	pa_threaded_mainloop_lock(self->mainloop);
+	int error = pulseaudio_stream_check(self);
+	if (error == 0) {
+		ops[0] = pa_stream_cork(self->stream, 1, NULL, NULL);
+		ops[1] = pa_stream_flush(self->stream, NULL, NULL);
+		for (int i = 0; i < 2; ++i) {
+			if (ops[i])
+				pa_operation_unref(ops[i]);
+			else if (error == 0)
+				error = pulseaudio_stream_errno(self);
+		}
+	}
+	if (error == 0) {
+		pulseaudio_stream_set_callbacks(self->stream, NULL);
+		pa_context_set_state_callback(self->context, NULL, NULL);
+	}
+	pa_threaded_mainloop_unlock(self->mainloop);
+	if (error != 0) {
+		free(pooled);
+		return;
+	}
+
+	pooled->mainloop = self->mainloop;
+	pooled->context = self->context;
+	pooled->stream = self->stream;
+	pooled->ss = self->ss;
+	pooled->frame_size = self->frame_size;
+	pooled->device_format = self->vtable.device_format;
+	pooled->negotiated = self->vtable.negotiated;
+	self->mainloop = NULL;
+	self->context = NULL;
+	self->stream = NULL;
+	self->write_buffer = NULL;
+	audio_pool_put(&self->key, pooled, pulseaudio_stream_handle_release);
+}
+
+// Start the mainloop the context and stream run on.
+static int
+pulseaudio_stream_start(struct pulseaudio_stream *self)
+{
+	self->mainloop = pa_threaded_mainloop_new();
+	if (self->mainloop && pa_threaded_mainloop_start(self->mainloop) < 0) {
+		pa_threaded_mainloop_free(self->mainloop);
+		self->mainloop = NULL;
+	}
+	return self->mainloop ? 0 : PA_ERR_INTERNAL;
+}
+
+int
+pulseaudio_stream_open(struct audio_object *object,
+                       enum audio_object_format format,
+                       uint32_t rate,
+                       uint8_t channels)
+{
+	struct pulseaudio_stream *self = to_pulseaudio_stream(object);
+	if (self->stream)
+		return PA_ERR_EXIST;
+
+	audio_pool_key_init(&self->key, object, "pulseaudio", self->device,
+	                    self->application_name, self->description, format, rate, channels);
+	struct pulseaudio_stream_handle *pooled = audio_pool_get(&self->key);
+	if (pooled && pulseaudio_stream_adopt(self, pooled) == 0)
+		return 0;
+
+	int error;
+	if (!self->mainloop && (error = pulseaudio_stream_start(self)) != 0)
+		return pulseaudio_object_error(object, "open", error);
+
+	format = audio_convert_nearest(format, pulseaudio_formats, sizeof(pulseaudio_formats) / sizeof(pulseaudio_formats[0]));
+	object->device_format = format;
+	self->ss.format = pulseaudio_sample_format(format);
+	self->ss.rate = rate;
+	self->ss.channels = channels;
+	if (self->ss.format == PA_SAMPLE_INVALID || !pa_sample_spec_valid(&self->ss))
+		return PA_ERR_INVALID; // Invalid argument.
+	self->frame_size = pa_frame_size(&self->ss);
+
+	pa_threaded_mainloop_lock(self->mainloop);
+	error = pulseaudio_stream_connect_playback(self, object);
+	if (error != 0)
+		pulseaudio_stream_disconnect(self);
+	pa_threaded_mainloop_unlock(self->mainloop);
+	return pulseaudio_object_error(object, "open", error);
+}
+
+void
+pulseaudio_stream_close(struct audio_object *object)
+{
+	struct pulseaudio_stream *self = to_pulseaudio_stream(object);
+	char buffer[16];
+
+	if (!self->mainloop)
+		return;
+
+	pulseaudio_stream_pool(self);
+	if (self->mainloop) {
+		pa_threaded_mainloop_lock(self->mainloop);
+		pulseaudio_stream_disconnect(self);
+		pa_threaded_mainloop_unlock(self->mainloop);
+	}
+
+	if (self->wake[0] != -1) {
+		while (read(self->wake[0], buffer, sizeof(buffer)) > 0)
+			;
+	}
+}
+
+void
+pulseaudio_stream_forget(struct audio_object *object)
+{
+	struct pulseaudio_stream *self = to_pulseaudio_stream(object);
+
+	// The mainloop thread is not running in this process, so the mainloop,
+	// context and stream cannot be used or freed.
+	self->mainloop = NULL;
+	self->context = NULL;
+	self->stream = NULL;
+	self->write_buffer = NULL;
+	self->drain = NULL;
+}
+
+void
+pulseaudio_stream_destroy(struct audio_object *object)
+{
+	struct pulseaudio_stream *self = to_pulseaudio_stream(object);
+
+	pulseaudio_stream_free_mainloop(self);
+	if (self->wake[0] != -1) {
+		close(self->wake[0]);
+		close(self->wake[1]);
+	}
+	free(self->device);
+	free(self->application_name);
+	free(self->description);
+	free(self);
+}
+
+// Wait for the server to request audio, with the mainloop lock held.
+static int
+pulseaudio_stream_wait_writable(struct pulseaudio_stream *self,
+                                size_t *bytes)
+{
+	int error;
+	for (;;) {
+		if ((error = pulseaudio_stream_check(self)) != 0)
+			return error;
+		if (audio_write_cancelled(&self->vtable))
+			return -ECANCELED;
+
+		*bytes = pa_stream_writable_size(self->stream);
+		if (*bytes == (size_t) -1)
+			return pulseaudio_stream_errno(self);
+		if (*bytes >= self->frame_size)
+			return 0;
+		pa_threaded_mainloop_wait(self->mainloop);
+	}
+}
+
+int
+pulseaudio_stream_write(struct audio_object *object,
+                        const void *data,
+                        size_t bytes)
+{
+	struct pulseaudio_stream *self = to_pulseaudio_stream(object);
+	if (!self->stream)
+		return 0;
+
+	int error = 0;
+	pa_threaded_mainloop_lock(self->mainloop);
+	while (bytes > 0) {
+		size_t writable;
+		if ((error = pulseaudio_stream_wait_writable(self, &writable)) != 0)
+			break;
+
+		size_t count = writable < bytes ? writable - writable % self->frame_size : bytes;
+		if (pa_stream_write(self->stream, data, count, NULL, 0, PA_SEEK_RELATIVE) < 0) {
+			error = pulseaudio_stream_errno(self);
+			break;
+		}
+		data = (const char *)data + count;
+		bytes -= count;
+	}
+	pa_threaded_mainloop_unlock(self->mainloop);
+	return pulseaudio_object_error(object, "write", error);
+}
+
+int
+pulseaudio_stream_begin_write(struct audio_object *object,
+                              void **data,
+                              size_t *frames)
+{
+	struct pulseaudio_stream *self = to_pulseaudio_stream(object);
+	if (!self->stream)
+		return -EBADF;
+
+	size_t bytes;
+	pa_threaded_mainloop_lock(self->mainloop);
+	int error = pulseaudio_stream_wait_writable(self, &bytes);
+	if (error == 0) {
+		if (*frames != 0 && *frames * self->frame_size < bytes)
+			bytes = *frames * self->frame_size;
+		// Write straight into the shared memory block sent to the server.
+		if (pa_stream_begin_write(self->stream, data, &bytes) < 0)
+			error = pulseaudio_stream_errno(self);
+		else {
+			self->write_buffer = *data;
+			*frames = bytes / self->frame_size;
+		}
+	}
+	pa_threaded_mainloop_unlock(self->mainloop);
+	return pulseaudio_object_error(object, "begin_write", error);
+}
+
+int
+pulseaudio_stream_commit(struct audio_object *object,
+                         size_t frames)
+{
+	struct pulseaudio_stream *self = to_pulseaudio_stream(object);
+	if (!self->stream)
+		return -EBADF;
+
+	int error = 0;
+	pa_threaded_mainloop_lock(self->mainloop);
+	if (!self->write_buffer)
+		error = -EINVAL;
+	else if (frames == 0)
+		pa_stream_cancel_write(self->stream);
+	// The data must be the buffer returned by pa_stream_begin_write, so
+	// that libpulse sends the memory block without copying it.
+	else if (pa_stream_write(self->stream, self->write_buffer, frames * self->frame_size, NULL, 0, PA_SEEK_RELATIVE) < 0)
+		error = pulseaudio_stream_errno(self);
+	self->write_buffer = NULL;
+	pa_threaded_mainloop_unlock(self->mainloop);
+	return pulseaudio_object_error(object, "commit", error);
+}
+
+int
+pulseaudio_stream_drain_until(struct audio_object *object,
+                              uint64_t deadline,
+                              uint64_t generation)
+{
+	struct pulseaudio_stream *self = to_pulseaudio_stream(object);
+	if (!self->stream)
+		return 0;
+
+	int error = 0;
+	pa_time_event *timer = NULL;
+	pa_threaded_mainloop_lock(self->mainloop);
+
+	self->drain_success = 0;
+	self->timed_out = 0;
+	self->drain = pa_stream_drain(self->stream, pulseaudio_stream_drained, self);
+	if (!self->drain)
+		error = pulseaudio_stream_errno(self);
+
+	int remaining = audio_drain_remaining(deadline);
+	if (self->drain && remaining > 0)
+		timer = pa_context_rttime_new(self->context,
+		                              pa_rtclock_now() + (pa_usec_t)remaining * PA_USEC_PER_MSEC,
+		                              pulseaudio_stream_timeout,
+		                              self);
+
+	while (self->drain && pa_operation_get_state(self->drain) == PA_OPERATION_RUNNING) {
+		if (audio_counter_get(&object->drain_generation) != generation) {
+			error = -ECANCELED;
+			break;
+		}
+		if (self->timed_out || remaining == 0) {
+			error = -ETIMEDOUT;
+			break;
+		}
+		if ((error = pulseaudio_stream_check(self)) != 0)
+			break;
+		pa_threaded_mainloop_wait(self->mainloop);
+	}
+
+	if (self->drain) {
+		if (pa_operation_get_state(self->drain) == PA_OPERATION_RUNNING)
+			pa_operation_cancel(self->drain);
+		else if (error == 0 && !self->drain_success)
+			error = pulseaudio_stream_errno(self);
+		pa_operation_unref(self->drain);
+		self->drain = NULL;
+	}
+	if (timer)
+		pa_threaded_mainloop_get_api(self->mainloop)->time_free(timer);
+
+	pa_threaded_mainloop_unlock(self->mainloop);
+	if (error < 0)
+		return error;
+	return pulseaudio_object_error(object, "drain", error);
+}
+
+int
+pulseaudio_stream_drain(struct audio_object *object)
+{
+	return pulseaudio_stream_drain_until(object, UINT64_MAX, audio_counter_get(&object->drain_generation));
+}
+
+void
+pulseaudio_stream_wake(struct audio_object *object)
+{
+	struct pulseaudio_stream *self = to_pulseaudio_stream(object);
+	if (!self->mainloop)
+		return;
+
+	pa_threaded_mainloop_lock(self->mainloop);
+	pulseaudio_stream_signal(self);
+	pa_threaded_mainloop_unlock(self->mainloop);
+}
+
+int
+pulseaudio_stream_flush(struct audio_object *object)
+{
+	struct pulseaudio_stream *self = to_pulseaudio_stream(object);
+	if (!self->stream)
+		return 0;
+
+	// Cork the stream so it stops straight away, drop the queued audio and
+	// uncork it again. The requests are handled in order by the server, so
+	// there is no need to wait for the replies; audio written after this
+	// returns is queued behind them. The stream goes back to waiting for
+	// prebuf, so it starts again as quickly as it did when opened.
+	pa_operation *ops[3];
+	int error = 0;
+	pa_threaded_mainloop_lock(self->mainloop);
+	if ((error = pulseaudio_stream_check(self)) == 0) {
+		ops[0] = pa_stream_cork(self->stream, 1, NULL, NULL);
+		ops[1] = pa_stream_flush(self->stream, NULL, NULL);
+		ops[2] = pa_stream_cork(self->stream, 0, NULL, NULL);
+		for (int i = 0; i < 3; ++i) {
+			if (ops[i])
+				pa_operation_unref(ops[i]);
+			else if (error == 0)
+				error = pulseaudio_stream_errno(self);
+		}
+	}
+	pa_threaded_mainloop_unlock(self->mainloop);
+	return pulseaudio_object_error(object, "flush", error);
+}
+
+int
+pulseaudio_stream_set_standby(struct audio_object *object,
+                              int enable)
+{
+	struct pulseaudio_stream *self = to_pulseaudio_stream(object);
+	if (!self->stream)
+		return 0;
+
+	// Leave the stream corked while it is in standby, so the server does
+	// not play silence and can suspend the sink.
+	pa_operation *ops[2] = { NULL, NULL };
+	int count = enable ? 2 : 1;
+	int error = 0;
+	pa_threaded_mainloop_lock(self->mainloop);
+	if ((error = pulseaudio_stream_check(self)) == 0) {
+		ops[0] = pa_stream_cork(self->stream, enable, NULL, NULL);
+		if (enable)
+			ops[1] = pa_stream_flush(self->stream, NULL, NULL);
+		for (int i = 0; i < count; ++i) {
+			if (ops[i])
+				pa_operation_unref(ops[i]);
+			else if (error == 0)
+				error = pulseaudio_stream_errno(self);
+		}
+	}
+	pa_threaded_mainloop_unlock(self->mainloop);
+	return pulseaudio_object_error(object, "standby", error);
+}
+
+int
+pulseaudio_stream_delay(struct audio_object *object,
+                        size_t *frames)
+{
+	struct pulseaudio_stream *self = to_pulseaudio_stream(object);
+	*frames = 0;
+	if (!self->stream)
+		return 0;
+
+	pa_usec_t latency = 0;
+	int negative = 0;
+	int error = 0;
+
+	// The latency is interpolated from the last timing update, so this does
+	// not wait for the server.
+	pa_threaded_mainloop_lock(self->mainloop);
+	if (pa_stream_get_latency(self->stream, &latency, &negative) < 0) {
+		error = pulseaudio_stream_errno(self);
+		if (error == PA_ERR_NODATA) // No timing update has been received yet.
+			error = 0;
+	} else if (!negative)
+		*frames = latency * self->ss.rate / PA_USEC_PER_SEC;
+	pa_threaded_mainloop_unlock(self->mainloop);
+	return pulseaudio_object_error(object, "delay", error);
+}
+
+int
+pulseaudio_stream_get_pollfds(struct audio_object *object,
+                              struct audio_object_pollfd *fds,
+                              unsigned int space)
+{
+	struct pulseaudio_stream *self = to_pulseaudio_stream(object);
+	if (!self->stream || self->wake[0] == -1)
+		return -EBADF;
+
+	if (space > 0) {
+		fds[0].fd = self->wake[0];
+		fds[0].events = POLLIN;
+		fds[0].revents = 0;
+	}
+	return 1;
+}
+
+int
+pulseaudio_stream_service(struct audio_object *object,
+                          const struct audio_object_pollfd *fds,
+                          unsigned int nfds,
+                          size_t *frames)
+{
+	struct pulseaudio_stream *self = to_pulseaudio_stream(object);
+	char buffer[16];
+
+	*frames = 0;
+	if (!self->stream)
+		return -EBADF;
+
+	while (read(self->wake[0], buffer, sizeof(buffer)) > 0)
+		;
+
+	int error;
+	pa_threaded_mainloop_lock(self->mainloop);
+	if ((error = pulseaudio_stream_check(self)) == 0) {
+		size_t bytes = pa_stream_writable_size(self->stream);
+		if (bytes == (size_t) -1)
+			error = pulseaudio_stream_errno(self);
+		else
+			*frames = bytes / self->frame_size;
+	}
+	pa_threaded_mainloop_unlock(self->mainloop);
+	return pulseaudio_object_error(object, "service", error);
+}
+
+/* The time to wait for the server when probing for it. */
+#define PROBE_TIMEOUT_US 250000
+
+/* The file in $XDG_RUNTIME_DIR used to share the probe result between
+ * processes when PCAUDIO_PROBE_CACHE_TTL is set to a number of seconds. */
+#define PROBE_CACHE_FILE "pcaudiolib-pulseaudio-probe"
+
+enum probe_result
+{
+	PROBE_PENDING = -1,
+	PROBE_UNAVAILABLE = 0,
+	PROBE_AVAILABLE = 1,
+};
+
+struct probe
+{
+	const char *device;
+	enum probe_result result;
+};
+
+static void
+probe_sink_info(pa_context *context,
+                const pa_sink_info *info,
+                int eol,
+                void *userdata)
+{
+	struct probe *probe = userdata;
+	if (info)
+		probe->result = PROBE_AVAILABLE;
+	else if (eol != 0 && probe->result == PROBE_PENDING)
+		probe->result = PROBE_UNAVAILABLE;
+}
+
+static void
+probe_context_state(pa_context *context,
+                    void *userdata)
+{
+	struct probe *probe = userdata;
+	pa_operation *op;
+
+	switch (pa_context_get_state(context))
+	{
+	case PA_CONTEXT_READY:
+		if (!probe->device) {
+			probe->result = PROBE_AVAILABLE;
+			break;
+		}
+		// Check that the sink exists, as opening a stream on it would.
+		op = pa_context_get_sink_info_by_name(context, probe->device, probe_sink_info, probe);
+		if (op)
+			pa_operation_unref(op);
+		else
+			probe->result = PROBE_UNAVAILABLE;
+		break;
+	case PA_CONTEXT_FAILED:
+	case PA_CONTEXT_TERMINATED:
+		probe->result = PROBE_UNAVAILABLE;
+		break;
+	default:
+		break;
+	}
+}
+
+static pa_usec_t
+probe_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (pa_usec_t)ts.tv_sec * PA_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+// Connect to the server without creating a playback stream or spawning a
+// server, giving up after PROBE_TIMEOUT_US.
+static enum probe_result
+pulseaudio_probe(const char *device,
+                 const char *application_name)
+{
+	struct probe probe = { device, PROBE_PENDING };
+
+	pa_mainloop *mainloop = pa_mainloop_new();
+	if (!mainloop)
+		return PROBE_UNAVAILABLE;
+
+	pa_context *context = pa_context_new(pa_mainloop_get_api(mainloop),
+	                                     application_name ? application_name : "pcaudiolib");
+	if (!context) {
+		pa_mainloop_free(mainloop);
+		return PROBE_UNAVAILABLE;
+	}
+
+	pa_context_set_state_callback(context, probe_context_state, &probe);
+	if (pa_context_connect(context, NULL, PA_CONTEXT_NOAUTOSPAWN, NULL) < 0)
+		probe.result = PROBE_UNAVAILABLE;
+
+	pa_usec_t deadline = probe_now() + PROBE_TIMEOUT_US;
+	while (probe.result == PROBE_PENDING) {
+		pa_usec_t now = probe_now();
+		if (now >= deadline ||
+		    pa_mainloop_prepare(mainloop, (int)(deadline - now)) < 0 ||
+		    pa_mainloop_poll(mainloop) < 0 ||
+		    pa_mainloop_dispatch(mainloop) < 0)
+			probe.result = PROBE_UNAVAILABLE;
+	}
+
+	pa_context_set_state_callback(context, NULL, NULL);
+	pa_context_disconnect(context);
+	pa_context_unref(context);
+	pa_mainloop_free(mainloop);
+	return probe.result;
+}
+
+static char *
+probe_cache_path(void)
+{
+	const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+	if (!runtime_dir || !*runtime_dir)
+		return NULL;
+
+	size_t length = strlen(runtime_dir) + sizeof(PROBE_CACHE_FILE) + 1;
+	char *path = malloc(length);
+	if (path)
+		snprintf(path, length, "%s/%s", runtime_dir, PROBE_CACHE_FILE);
+	return path;
+}
+
+static enum probe_result
+probe_cache_read(const char *path,
+                 long ttl)
+{
+	struct stat st;
+	char value = 0;
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return PROBE_PENDING;
+	if (fstat(fd, &st) == -1 || time(NULL) - st.st_mtime >= ttl || read(fd, &value, 1) != 1)
+		value = 0;
+	close(fd);
+
+	switch (value)
+	{
+	case '1': return PROBE_AVAILABLE;
+	case '0': return PROBE_UNAVAILABLE;
+	default:  return PROBE_PENDING;
+	}
+}
+
+static void
+probe_cache_write(const char *path,
+                  enum probe_result result)
+{
+	size_t length = strlen(path) + 32;
+	char *temp = malloc(length);
+	if (!temp)
+		return;
+
+	// Write to a temporary file and rename it so readers never see a
+	// partially written file.
+	snprintf(temp, length, "%s.%ld", path, (long)getpid());
+	int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd != -1) {
+		char value = result == PROBE_AVAILABLE ? '1' : '0';
+		int ok = write(fd, &value, 1) == 1;
+		close(fd);
+		if (!ok || rename(temp, path) == -1)
+			unlink(temp);
+	}
+	free(temp);
+}
+
+static pthread_mutex_t probe_mutex = PTHREAD_MUTEX_INITIALIZER;
+static enum probe_result probe_cached = PROBE_PENDING;
+
 static bool
 pulseaudio_is_available(const char *device,
                         const char *application_name,
                         const char *description)
 {
-	pa_sample_spec ss;
-	ss.format = PA_SAMPLE_S16LE;
-	ss.rate = 44100;
-	ss.channels = 1;
-
-	pa_simple *s = pa_simple_new(NULL,
-	                             application_name,
-	                             PA_STREAM_PLAYBACK,
-	                             device,
-	                             description,
-	                             &ss,
-	                             NULL,
-	                             NULL,
-	                             NULL);
-
-	if (!s)
-		return false;
+	// Only the default device is cached, as other devices can come and go.
+	if (device)
+		return pulseaudio_probe(device, application_name) == PROBE_AVAILABLE;
 
-	pa_simple_free(s);
-	return true;
+	pthread_mutex_lock(&probe_mutex);
+	enum probe_result result = probe_cached;
+	if (result == PROBE_PENDING) {
+		const char *ttl = getenv("PCAUDIO_PROBE_CACHE_TTL");
+		char *path = ttl && atol(ttl) > 0 ? probe_cache_path() : NULL;
+		if (path)
+			result = probe_cache_read(path, atol(ttl));
+		if (result == PROBE_PENDING) {
+			result = pulseaudio_probe(NULL, application_name);
+			if (path)
+				probe_cache_write(path, result);
+		}
+		free(path);
+		probe_cached = result;
+	}
+	pthread_mutex_unlock(&probe_mutex);
+	return result == PROBE_AVAILABLE;
 }
 
 struct audio_object *
@@ -195,7 +1298,55 @@ create_pulseaudio_object(const char *device,
 	if (!pulseaudio_is_available(device, application_name, description))
 		return NULL;
 
-	struct pulseaudio_object *self = malloc(sizeof(struct pulseaudio_object));
+	struct pulseaudio_stream *self = calloc(1, sizeof(struct pulseaudio_stream));
+	if (!self)
+		return NULL;
+
+	// The mainloop is started by the first open that does not take a stream
+	// from the handle pool.
+	self->mainloop = NULL;
+	self->context = NULL;
+	self->stream = NULL;
+	self->device = device ? strdup(device) : NULL;
+	self->application_name = application_name ? strdup(application_name) : NULL;
+	self->description = description ? strdup(description) : NULL;
+	if (pipe(self->wake) == 0) {
+		for (int i = 0; i < 2; ++i) {
+			fcntl(self->wake[i], F_SETFL, O_NONBLOCK);
+			fcntl(self->wake[i], F_SETFD, FD_CLOEXEC);
+		}
+	} else
+		self->wake[0] = self->wake[1] = -1;
+
+	self->vtable.open = pulseaudio_stream_open;
+	self->vtable.close = pulseaudio_stream_close;
+	self->vtable.forget = pulseaudio_stream_forget;
+	self->vtable.destroy = pulseaudio_stream_destroy;
+	self->vtable.write = pulseaudio_stream_write;
+	self->vtable.drain = pulseaudio_stream_drain;
+	self->vtable.flush = pulseaudio_stream_flush;
+	self->vtable.strerror = pulseaudio_object_strerror;
+	self->vtable.begin_write = pulseaudio_stream_begin_write;
+	self->vtable.commit = pulseaudio_stream_commit;
+	self->vtable.delay = pulseaudio_stream_delay;
+	self->vtable.drain_until = pulseaudio_stream_drain_until;
+	self->vtable.wake = pulseaudio_stream_wake;
+	self->vtable.set_standby = pulseaudio_stream_set_standby;
+	self->vtable.get_pollfds = pulseaudio_stream_get_pollfds;
+	self->vtable.service = pulseaudio_stream_service;
+
+	return &self->vtable;
+}
+
+struct audio_object *
+create_pulseaudio_simple_object(const char *device,
+                                const char *application_name,
+                                const char *description)
+{
+	if (!pulseaudio_is_available(device, application_name, description))
+		return NULL;
+
+	struct pulseaudio_object *self = calloc(1, sizeof(struct pulseaudio_object));
 	if (!self)
 		return NULL;
 
@@ -206,11 +1357,13 @@ create_pulseaudio_object(const char *device,
 
 	self->vtable.open = pulseaudio_object_open;
 	self->vtable.close = pulseaudio_object_close;
+	self->vtable.forget = pulseaudio_object_forget;
 	self->vtable.destroy = pulseaudio_object_destroy;
 	self->vtable.write = pulseaudio_object_write;
 	self->vtable.drain = pulseaudio_object_drain;
 	self->vtable.flush = pulseaudio_object_flush;
 	self->vtable.strerror = pulseaudio_object_strerror;
+	self->vtable.delay = pulseaudio_object_delay;
 
 	return &self->vtable;
 }
@@ -225,4 +1378,12 @@ create_pulseaudio_object(const char *device,
 	return NULL;
 }
 
+struct audio_object *
+create_pulseaudio_simple_object(const char *device,
+                                const char *application_name,
+                                const char *description)
+{
+	return NULL;
+}
+
 #endif
@@ -39,6 +39,13 @@ struct qsa_object
 
 #define to_qsa_object(object) container_of(object, struct qsa_object, vtable)
 
+static const enum audio_object_format qsa_formats[] =
+{
+	AUDIO_OBJECT_FORMAT_U8,
+	AUDIO_OBJECT_FORMAT_S8,
+	AUDIO_OBJECT_FORMAT_S16LE,
+};
+
 int
 qsa_object_open(struct audio_object *object,
                 enum audio_object_format format,
@@ -50,6 +57,8 @@ qsa_object_open(struct audio_object *object,
 		return -EEXIST;
 
 	int pcm_format;
+	format = audio_convert_nearest(format, qsa_formats, sizeof(qsa_formats) / sizeof(qsa_formats[0]));
+	object->device_format = format;
 #define FORMAT(srcfmt, dstfmt, size) case srcfmt: pcm_format = dstfmt; self->sample_size = size; break;
 	switch (format)
 	{
@@ -193,7 +202,7 @@ create_qsa_object(const char *device,
                   const char *application_name,
                   const char *description)
 {
-	struct qsa_object *self = malloc(sizeof(struct qsa_object));
+	struct qsa_object *self = calloc(1, sizeof(struct qsa_object));
 	if (!self)
 		return NULL;
 
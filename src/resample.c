@@ -0,0 +1,414 @@
+/* Sample Rate Conversion.
+ *
+ * Copyright (C) 2026 Reece H. Dunn
+ *
+ * This file is part of pcaudiolib.
+ *
+ * pcaudiolib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pcaudiolib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pcaudiolib.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "audio_priv.h"
+
+#include <math.h>
+#include <string.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) && defined(__aarch64__) && defined(__ARM_NEON)
+#define HAVE_NEON_KERNELS
+#include <arm_neon.h>
+#endif
+
+/* The filter length is a multiple of this, so the SIMD kernels do not need to
+ * handle a tail. */
+#define TAPS_ALIGN 8
+
+/* The maximum filter length, reached when downsampling by a large ratio. */
+#define MAX_TAPS 512
+
+/* Ratios with up to this many phases use a filter for each phase. Other
+ * ratios interpolate between MAX_PHASES filters. */
+#define MAX_PHASES 256
+
+/* The number of frames resampled at a time. */
+#define RESAMPLE_BLOCK 1024
+
+struct resample_quality
+{
+	uint32_t taps;  // filter length when upsampling
+	float cutoff;   // passband edge, relative to the lower Nyquist frequency
+	float beta;     // Kaiser window parameter
+};
+
+static const struct resample_quality qualities[] =
+{
+	{ 16, 0.85f,  6.0f }, // AUDIO_OBJECT_RESAMPLE_FAST   (~60dB stopband)
+	{ 32, 0.90f,  8.0f }, // AUDIO_OBJECT_RESAMPLE_MEDIUM (~80dB stopband)
+	{ 64, 0.95f, 10.0f }, // AUDIO_OBJECT_RESAMPLE_BEST   (~100dB stopband)
+};
+
+/* ------------------------------------------------------------------------- */
+/* Dot product kernels                                                       */
+
+static float
+scalar_dot(const float *a, const float *b, size_t n)
+{
+	float sum[4] = { 0, 0, 0, 0 };
+	for (size_t i = 0; i < n; i += 4) {
+		sum[0] += a[i]     * b[i];
+		sum[1] += a[i + 1] * b[i + 1];
+		sum[2] += a[i + 2] * b[i + 2];
+		sum[3] += a[i + 3] * b[i + 3];
+	}
+	return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+}
+
+#ifdef HAVE_X86_KERNELS
+
+__attribute__((target("sse")))
+static float
+sse_dot(const float *a, const float *b, size_t n)
+{
+	__m128 sum0 = _mm_setzero_ps();
+	__m128 sum1 = _mm_setzero_ps();
+	for (size_t i = 0; i < n; i += 8) {
+		sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i),     _mm_loadu_ps(b + i)));
+		sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+	}
+	sum0 = _mm_add_ps(sum0, sum1);
+	sum0 = _mm_add_ps(sum0, _mm_movehl_ps(sum0, sum0));
+	sum0 = _mm_add_ss(sum0, _mm_shuffle_ps(sum0, sum0, 1));
+	return _mm_cvtss_f32(sum0);
+}
+
+__attribute__((target("avx,fma")))
+static float
+avx_dot(const float *a, const float *b, size_t n)
+{
+	__m256 sum = _mm256_setzero_ps();
+	for (size_t i = 0; i < n; i += 8)
+		sum = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum);
+
+	__m128 x = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+	x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+	x = _mm_add_ss(x, _mm_shuffle_ps(x, x, 1));
+	return _mm_cvtss_f32(x);
+}
+
+#endif
+
+#ifdef HAVE_NEON_KERNELS
+
+static float
+neon_dot(const float *a, const float *b, size_t n)
+{
+	float32x4_t sum0 = vdupq_n_f32(0);
+	float32x4_t sum1 = vdupq_n_f32(0);
+	for (size_t i = 0; i < n; i += 8) {
+		sum0 = vfmaq_f32(sum0, vld1q_f32(a + i),     vld1q_f32(b + i));
+		sum1 = vfmaq_f32(sum1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+	}
+	return vaddvq_f32(vaddq_f32(sum0, sum1));
+}
+
+#endif
+
+static const char *dot_name = "scalar";
+static float (*dot)(const float *a, const float *b, size_t n) = scalar_dot;
+
+static void
+select_kernels(void)
+{
+#if defined(HAVE_X86_KERNELS)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse")) {
+		dot_name = "sse";
+		dot = sse_dot;
+	}
+	if (__builtin_cpu_supports("avx") && __builtin_cpu_supports("fma")) {
+		dot_name = "avx";
+		dot = avx_dot;
+	}
+#elif defined(HAVE_NEON_KERNELS)
+	dot_name = "neon";
+	dot = neon_dot;
+#endif
+}
+
+static void
+init_kernels(void)
+{
+#ifdef HAVE_PTHREAD_H
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	pthread_once(&once, select_kernels);
+#else
+	static int initialized = 0;
+	if (!initialized) {
+		select_kernels();
+		initialized = 1;
+	}
+#endif
+}
+
+const char *
+audio_resample_kernels(void)
+{
+	init_kernels();
+	return dot_name;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Filter design                                                             */
+
+// The zeroth order modified Bessel function of the first kind.
+static double
+bessel_i0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+	for (int k = 1; k < 32; ++k) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+		if (term < sum * 1e-12)
+			break;
+	}
+	return sum;
+}
+
+/* Fill `coeffs` with a Kaiser windowed sinc low pass filter that is evaluated
+ * `offset` input samples after the centre tap, normalized for unity gain. */
+static void
+design_phase(float *coeffs, uint32_t taps, double offset, double cutoff, double beta)
+{
+	double half = taps / 2.0;
+	double sum = 0;
+	for (uint32_t j = 0; j < taps; ++j) {
+		double t = (double)j - (half - 1.0) - offset;
+		double x = t / half;
+		double window = x <= -1.0 || x >= 1.0 ? 0.0 : bessel_i0(beta * sqrt(1.0 - x * x)) / bessel_i0(beta);
+		double sinc = t == 0.0 ? 1.0 : sin(M_PI * cutoff * t) / (M_PI * cutoff * t);
+		coeffs[j] = (float)(cutoff * sinc * window);
+		sum += coeffs[j];
+	}
+	for (uint32_t j = 0; j < taps; ++j)
+		coeffs[j] = (float)(coeffs[j] / sum);
+}
+
+/* ------------------------------------------------------------------------- */
+/* Polyphase resampler                                                       */
+
+/* Output frame n is the input evaluated at n * step / interp. `pos` is the
+ * integer part of that (relative to the history buffer) and `phase` the
+ * fractional part in units of 1/interp.
+ */
+struct audio_resample
+{
+	uint32_t interp;
+	uint32_t step;
+	uint8_t channels;
+	uint32_t taps;
+
+	float *filters;   // filters of `taps` coefficients for each phase
+	uint32_t phases;  // 0, or the number of filters to interpolate between
+
+	float *history;   // per channel input, `capacity` frames each
+	size_t capacity;
+	size_t fill;
+	size_t pos;
+	uint32_t phase;
+};
+
+static uint32_t
+gcd(uint32_t a, uint32_t b)
+{
+	while (b != 0) {
+		uint32_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+struct audio_resample *
+audio_resample_create(uint32_t from_rate,
+                      uint32_t to_rate,
+                      uint8_t channels,
+                      enum audio_object_resample_quality quality)
+{
+	if (from_rate == 0 || to_rate == 0 || channels == 0)
+		return NULL;
+
+	init_kernels();
+
+	const struct resample_quality *q;
+	switch (quality)
+	{
+	case AUDIO_OBJECT_RESAMPLE_FAST: q = &qualities[0]; break;
+	case AUDIO_OBJECT_RESAMPLE_BEST: q = &qualities[2]; break;
+	default:                         q = &qualities[1]; break;
+	}
+
+	struct audio_resample *r = calloc(1, sizeof(struct audio_resample));
+	if (!r)
+		return NULL;
+
+	uint32_t g = gcd(from_rate, to_rate);
+	r->interp = to_rate / g;
+	r->step = from_rate / g;
+	r->channels = channels;
+
+	// When downsampling, the cutoff is lowered to the output Nyquist frequency
+	// and the filter is lengthened to keep the same transition band.
+	double ratio = (double)to_rate / from_rate;
+	double cutoff = q->cutoff * (ratio < 1.0 ? ratio : 1.0);
+	double taps = ratio < 1.0 ? q->taps / ratio : q->taps;
+	r->taps = ((uint32_t)ceil(taps) + TAPS_ALIGN - 1) & ~(TAPS_ALIGN - 1);
+	if (r->taps > MAX_TAPS)
+		r->taps = MAX_TAPS;
+
+	uint32_t filters = r->interp <= MAX_PHASES ? r->interp : MAX_PHASES + 1;
+	r->phases = r->interp <= MAX_PHASES ? 0 : MAX_PHASES;
+	r->filters = malloc((size_t)filters * r->taps * sizeof(float));
+
+	r->capacity = r->taps + RESAMPLE_BLOCK;
+	r->history = malloc(r->capacity * channels * sizeof(float));
+	if (!r->filters || !r->history) {
+		audio_resample_destroy(r);
+		return NULL;
+	}
+
+	for (uint32_t p = 0; p < filters; ++p) {
+		double offset = (double)p / (r->phases ? r->phases : r->interp);
+		design_phase(r->filters + (size_t)p * r->taps, r->taps, offset, cutoff, q->beta);
+	}
+
+	audio_resample_reset(r);
+	return r;
+}
+
+void
+audio_resample_destroy(struct audio_resample *r)
+{
+	if (!r)
+		return;
+
+	free(r->filters);
+	free(r->history);
+	free(r);
+}
+
+void
+audio_resample_reset(struct audio_resample *r)
+{
+	// Prime the history so the centre of the filter is on the first frame.
+	r->fill = r->taps / 2 - 1;
+	r->pos = 0;
+	r->phase = 0;
+	memset(r->history, 0, r->capacity * r->channels * sizeof(float));
+}
+
+size_t
+audio_resample_delay(struct audio_resample *r)
+{
+	return r->taps / 2;
+}
+
+size_t
+audio_resample_max_output(struct audio_resample *r,
+                          size_t frames)
+{
+	return (size_t)(((uint64_t)(frames + r->taps) * r->interp) / r->step) + 1;
+}
+
+static float
+resample_frame(struct audio_resample *r, const float *history)
+{
+	if (!r->phases)
+		return dot(history, r->filters + (size_t)r->phase * r->taps, r->taps);
+
+	// Interpolate between the two nearest filters.
+	uint64_t scaled = (uint64_t)r->phase * r->phases;
+	uint32_t p = (uint32_t)(scaled / r->interp);
+	float frac = (float)(scaled % r->interp) / r->interp;
+	const float *filter = r->filters + (size_t)p * r->taps;
+	float a = dot(history, filter, r->taps);
+	float b = dot(history, filter + r->taps, r->taps);
+	return a + (b - a) * frac;
+}
+
+size_t
+audio_resample_process(struct audio_resample *r,
+                       const float *in,
+                       size_t frames,
+                       float *out)
+{
+	size_t produced = 0;
+	while (frames > 0) {
+		// Append the input to the per channel history.
+		size_t count = r->capacity - r->fill;
+		if (count > frames)
+			count = frames;
+		for (uint8_t c = 0; c < r->channels; ++c) {
+			float *history = r->history + c * r->capacity + r->fill;
+			for (size_t i = 0; i < count; ++i)
+				history[i] = in[i * r->channels + c];
+		}
+		r->fill += count;
+		in += count * r->channels;
+		frames -= count;
+
+		while (r->pos + r->taps <= r->fill) {
+			for (uint8_t c = 0; c < r->channels; ++c)
+				*out++ = resample_frame(r, r->history + c * r->capacity + r->pos);
+			++produced;
+
+			r->phase += r->step;
+			r->pos += r->phase / r->interp;
+			r->phase %= r->interp;
+		}
+
+		// Keep the frames still needed by the next output frame.
+		size_t keep = r->pos < r->fill ? r->fill - r->pos : 0;
+		for (uint8_t c = 0; c < r->channels; ++c) {
+			float *history = r->history + c * r->capacity;
+			memmove(history, history + r->pos, keep * sizeof(float));
+		}
+		r->pos = r->pos < r->fill ? 0 : r->pos - r->fill;
+		r->fill = keep;
+	}
+	return produced;
+}
+
+size_t
+audio_resample_drain(struct audio_resample *r,
+                     float *out)
+{
+	// Push the frames still in the filter out with silence, then start over.
+	float zeros[UINT8_MAX];
+	memset(zeros, 0, sizeof(zeros));
+
+	size_t produced = 0;
+	for (uint32_t i = 0; i <= r->taps / 2; ++i)
+		produced += audio_resample_process(r, zeros, 1, out + produced * r->channels);
+	audio_resample_reset(r);
+	return produced;
+}
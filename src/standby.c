@@ -0,0 +1,295 @@
+/* Warm Standby.
+ *
+ * Copyright (C) 2026 Reece H. Dunn
+ *
+ * This file is part of pcaudiolib.
+ *
+ * pcaudiolib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pcaudiolib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pcaudiolib.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "audio_priv.h"
+
+/* An object closed with a standby time keeps its device open and stopped,
+ * and is put on a list of standby objects. A single reaper thread closes the
+ * devices whose time has run out, so the objects do not need a thread each.
+ * The lists and the standby state of every object are protected by one
+ * mutex. Devices are closed without it held, as closing can block; while the
+ * reaper is closing an object's device the object is marked as closing, and
+ * its owner waits for that before reopening or destroying it.
+ */
+
+#if defined(HAVE_PTHREAD_H)
+
+#include <pthread.h>
+#include <time.h>
+
+// Stop (enable is 1) or restart (enable is 0) the device without closing it.
+static int
+audio_standby_backend(struct audio_object *object,
+                      int enable)
+{
+	if (object->set_standby)
+		return object->set_standby(object, enable);
+	// Flushing leaves the device configured but not playing.
+	return enable ? object->flush(object) : 0;
+}
+
+static pthread_mutex_t standby_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t standby_cond = PTHREAD_COND_INITIALIZER;
+static struct audio_object *standby_list;
+static struct audio_object *standby_closing; // being closed by the reaper
+static int standby_thread_running;
+static pthread_once_t standby_once = PTHREAD_ONCE_INIT;
+
+static void
+standby_atfork_prepare(void)
+{
+	pthread_mutex_lock(&standby_mutex);
+}
+
+static void
+standby_atfork_parent(void)
+{
+	pthread_mutex_unlock(&standby_mutex);
+}
+
+// Take the objects on a list out of standby, marking them as forked so
+// their owners drop the parent's device before opening the object again.
+static void
+standby_forget(struct audio_object **list)
+{
+	struct audio_object *object = *list;
+	while (object) {
+		struct audio_object *next = object->standby.next;
+		object->standby.next = NULL;
+		object->standby.active = 0;
+		object->standby.closing = 0;
+		object->standby.forked = 1;
+		object = next;
+	}
+	*list = NULL;
+}
+
+// The devices in standby belong to the parent (and for PulseAudio, use
+// mainloop threads that do not exist in the child), so the child forgets
+// them without closing them, as the handle pool does. Only the forking
+// thread exists in the child, so the reaper is started again if the child
+// puts an object in standby.
+static void
+standby_atfork_child(void)
+{
+	standby_forget(&standby_list);
+	standby_forget(&standby_closing);
+	standby_thread_running = 0;
+	pthread_mutex_unlock(&standby_mutex);
+}
+
+static void
+standby_init(void)
+{
+	pthread_atfork(standby_atfork_prepare, standby_atfork_parent, standby_atfork_child);
+}
+
+// Remove the object from a list. Must be called with the mutex held.
+static void
+standby_remove(struct audio_object **list,
+               struct audio_object *object)
+{
+	for (struct audio_object **item = list; *item; item = &(*item)->standby.next) {
+		if (*item == object) {
+			*item = object->standby.next;
+			break;
+		}
+	}
+	object->standby.next = NULL;
+}
+
+// Drop the device of an object that was in standby when the process forked.
+static void
+standby_forget_device(struct audio_object *object)
+{
+	if (object->forget)
+		object->forget(object);
+	else
+		object->close(object);
+	audio_convert_destroy(object->convert);
+	object->convert = NULL;
+}
+
+// Wait for the reaper to finish closing the object, then take it out of
+// standby, returning whether it was in standby. Must be called with the
+// mutex held.
+static int
+standby_take(struct audio_object *object)
+{
+	while (object->standby.closing)
+		pthread_cond_wait(&standby_cond, &standby_mutex);
+	if (!object->standby.active)
+		return 0;
+
+	standby_remove(&standby_list, object);
+	object->standby.active = 0;
+	return 1;
+}
+
+static void *
+standby_thread(void *arg)
+{
+	pthread_mutex_lock(&standby_mutex);
+	while (standby_list) {
+		uint64_t now = audio_drain_deadline(0);
+		uint64_t next = UINT64_MAX;
+		struct audio_object **item = &standby_list;
+		struct audio_object *object = NULL;
+		while (*item) {
+			if ((*item)->standby.deadline <= now) {
+				object = *item;
+				break;
+			}
+			if ((*item)->standby.deadline < next)
+				next = (*item)->standby.deadline;
+			item = &(*item)->standby.next;
+		}
+
+		if (object) {
+			// Close the device without the mutex held, so a slow close does
+			// not hold up the other objects.
+			*item = object->standby.next;
+			object->standby.active = 0;
+			object->standby.closing = 1;
+			object->standby.next = standby_closing;
+			standby_closing = object;
+			pthread_mutex_unlock(&standby_mutex);
+
+			audio_close(object);
+
+			pthread_mutex_lock(&standby_mutex);
+			standby_remove(&standby_closing, object);
+			object->standby.closing = 0;
+			pthread_cond_broadcast(&standby_cond);
+			continue;
+		}
+
+		struct timespec ts;
+		audio_drain_abstime(next, &ts);
+		pthread_cond_timedwait(&standby_cond, &standby_mutex, &ts);
+	}
+	standby_thread_running = 0;
+	pthread_mutex_unlock(&standby_mutex);
+	return NULL;
+}
+
+int
+audio_standby_enter(struct audio_object *object)
+{
+	if (object->standby.idle_ms == 0)
+		return 0;
+	if (object->convert)
+		audio_convert_reset(object->convert);
+	if (audio_standby_backend(object, 1) != 0)
+		return 0;
+
+	pthread_once(&standby_once, standby_init);
+	pthread_mutex_lock(&standby_mutex);
+	if (!standby_thread_running) {
+		pthread_attr_t attr;
+		pthread_t thread;
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		standby_thread_running = pthread_create(&thread, &attr, standby_thread, NULL) == 0;
+		pthread_attr_destroy(&attr);
+		if (!standby_thread_running) {
+			pthread_mutex_unlock(&standby_mutex);
+			return 0;
+		}
+	}
+
+	object->standby.deadline = audio_drain_deadline(object->standby.idle_ms);
+	object->standby.active = 1;
+	object->standby.stale = 0;
+	object->standby.next = standby_list;
+	standby_list = object;
+	// The condition is shared with the owners waiting for a close.
+	pthread_cond_broadcast(&standby_cond);
+	pthread_mutex_unlock(&standby_mutex);
+	return 1;
+}
+
+int
+audio_standby_resume(struct audio_object *object,
+                     enum audio_object_format format,
+                     uint32_t rate,
+                     uint8_t channels)
+{
+	pthread_mutex_lock(&standby_mutex);
+	int forked = object->standby.forked;
+	object->standby.forked = 0;
+	if (!standby_take(object)) {
+		pthread_mutex_unlock(&standby_mutex);
+		if (forked)
+			standby_forget_device(object);
+		return 0;
+	}
+	int reuse = !object->standby.stale &&
+	            object->format == format &&
+	            object->rate == rate &&
+	            object->channels == channels;
+	pthread_mutex_unlock(&standby_mutex);
+
+	if (!reuse || audio_standby_backend(object, 0) != 0) {
+		audio_close(object);
+		return 0;
+	}
+	return 1;
+}
+
+void
+audio_standby_close(struct audio_object *object)
+{
+	pthread_mutex_lock(&standby_mutex);
+	int forked = object->standby.forked;
+	object->standby.forked = 0;
+	int active = standby_take(object);
+	pthread_mutex_unlock(&standby_mutex);
+
+	if (forked)
+		standby_forget_device(object);
+	else if (active)
+		audio_close(object);
+}
+
+#else
+
+int
+audio_standby_enter(struct audio_object *object)
+{
+	return 0;
+}
+
+int
+audio_standby_resume(struct audio_object *object,
+                     enum audio_object_format format,
+                     uint32_t rate,
+                     uint8_t channels)
+{
+	return 0;
+}
+
+void
+audio_standby_close(struct audio_object *object)
+{
+}
+
+#endif
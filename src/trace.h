@@ -0,0 +1,56 @@
+/* Static Tracepoints.
+ *
+ * Copyright (C) 2026 Reece H. Dunn
+ *
+ * This file is part of pcaudiolib.
+ *
+ * pcaudiolib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * pcaudiolib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with pcaudiolib.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PCAUDIOLIB_TRACE_H
+#define PCAUDIOLIB_TRACE_H
+
+/* SystemTap/USDT probes in the "pcaudiolib" provider, enabled by configuring
+ * with --enable-usdt. A disabled probe is a single nop instruction. When
+ * tracing is not enabled the macros compile away; the arguments are only
+ * referenced so values computed for a probe do not trigger warnings.
+ */
+
+#ifdef HAVE_USDT
+
+#include <sys/sdt.h>
+
+#define AUDIO_PROBE1(name, a) \
+	DTRACE_PROBE1(pcaudiolib, name, a)
+#define AUDIO_PROBE2(name, a, b) \
+	DTRACE_PROBE2(pcaudiolib, name, a, b)
+#define AUDIO_PROBE3(name, a, b, c) \
+	DTRACE_PROBE3(pcaudiolib, name, a, b, c)
+#define AUDIO_PROBE4(name, a, b, c, d) \
+	DTRACE_PROBE4(pcaudiolib, name, a, b, c, d)
+
+#else
+
+#define AUDIO_PROBE1(name, a) \
+	do { (void)(a); } while (0)
+#define AUDIO_PROBE2(name, a, b) \
+	do { (void)(a); (void)(b); } while (0)
+#define AUDIO_PROBE3(name, a, b, c) \
+	do { (void)(a); (void)(b); (void)(c); } while (0)
+#define AUDIO_PROBE4(name, a, b, c, d) \
+	do { (void)(a); (void)(b); (void)(c); (void)(d); } while (0)
+
+#endif
+
+#endif
@@ -59,6 +59,14 @@ xaudio2_object_close(struct audio_object *object);
 
 #define to_xaudio2_object(object) container_of(object, struct xaudio2_object, vtable)
 
+static const enum audio_object_format xaudio2_formats[] =
+{
+	AUDIO_OBJECT_FORMAT_S16LE,
+	AUDIO_OBJECT_FORMAT_S32LE,
+	AUDIO_OBJECT_FORMAT_FLOAT32LE,
+	AUDIO_OBJECT_FORMAT_FLOAT64LE,
+};
+
 int
 xaudio2_object_open(struct audio_object *object,
                     enum audio_object_format format,
@@ -74,6 +82,8 @@ xaudio2_object_open(struct audio_object *object,
 	if (FAILED(hr))
 		goto error;
 
+	format = audio_convert_nearest(format, xaudio2_formats, sizeof(xaudio2_formats) / sizeof(xaudio2_formats[0]));
+	object->device_format = format;
 	hr = CreateWaveFormat(format, rate, channels, &self->format);
 	if (FAILED(hr))
 		goto error;
@@ -211,7 +221,7 @@ create_xaudio2_object(const char *device,
 		return NULL;
 	}
 
-	struct xaudio2_object *self = (struct xaudio2_object *)malloc(sizeof(struct xaudio2_object));
+	struct xaudio2_object *self = (struct xaudio2_object *)calloc(1, sizeof(struct xaudio2_object));
 	if (!self)
 		return NULL;
 